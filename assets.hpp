@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "mesh.hpp"
+#include "utils.hpp"
+
+/**
+ * Loads assets in the background: files are read, decoded and parsed on loader threads,
+ * and the results are handed to the GL thread, which uploads them in poll(). Until then
+ * the targets keep showing their placeholders (see createTexture and genPlaceholderMesh).
+ *
+ * Without threads (the web build) poll() reads the queued assets inline instead, within
+ * the same time budget, so frames still start before everything is loaded.
+ */
+class AssetLoader {
+ public:
+  static unsigned defaultThreadCount() {
+#ifdef __EMSCRIPTEN__
+    return 0;
+#else
+    return std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+#endif
+  }
+
+  explicit AssetLoader(unsigned threads = defaultThreadCount()) {
+    for (unsigned i = 0; i < threads; i++)
+      threads_.emplace_back([this] { threadLoop(); });
+  }
+
+  AssetLoader(const AssetLoader&) = delete;
+  AssetLoader& operator=(const AssetLoader&) = delete;
+
+  /**
+   * Waits for the reads in progress; queued assets are dropped.
+   */
+  ~AssetLoader() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &thread : threads_)
+      thread.join();
+  }
+
+  /**
+   * Calls `read()` on a loader thread, then `upload(result)` on the GL thread from poll().
+   */
+  template <typename TRead, typename TUpload>
+  void load(TRead read, TUpload upload) {
+    using Result = decltype(read());
+    auto result = std::make_shared<std::optional<Result>>();
+    Job job{
+        [result, read]() mutable { result->emplace(read()); },
+        [result, upload]() mutable { upload(**result); }
+    };
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queued_.push_back(std::move(job));
+      pending_++;
+    }
+    wake_.notify_one();
+  }
+
+  /**
+   * Replaces the placeholder in `texture`, a GL_TEXTURE_2D from createTexture, see readTexture.
+   */
+  void texture(uint texture, const std::string &path) {
+    load([path] { return readTexture(path, true); },
+         [this, texture](const TextureAsset &asset) {
+           glBindTexture(GL_TEXTURE_2D, texture);
+             uploadTexture(asset, staging());
+           glBindTexture(GL_TEXTURE_2D, 0);
+         });
+  }
+
+  /**
+   * Replaces the placeholder faces of `texture`, a GL_TEXTURE_CUBE_MAP from createTexture.
+   * The faces are read in parallel but uploaded together: a cube map with faces of
+   * different sizes is incomplete and would sample black.
+   */
+  void cubemap(uint texture, const std::vector<std::string> &faces) {
+    assert(faces.size() == 6);
+    auto read = std::make_shared<std::array<TextureAsset, 6>>();
+    auto remaining = std::make_shared<size_t>(faces.size());
+    for (uint face = 0; face < faces.size(); face++) {
+      load([path = faces[face]] { return readTexture(path, false); },
+           [this, texture, face, read, remaining](TextureAsset &asset) {
+             (*read)[face] = std::move(asset);
+             if (--*remaining != 0)
+               return;
+             glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+               uploadCubemap(*read, staging());
+             glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+             for (TextureAsset &face_asset : *read)
+               face_asset = {};
+           });
+    }
+  }
+
+  /**
+   * Replaces `target` with the model once it is parsed, see readSimpleObj.
+   * `target` must outlive the loader.
+   */
+  void mesh(Mesh &target, const std::string &path, VertexFormat format, bool explodable) {
+    load([path, format, explodable] { return readSimpleObj(path, format, explodable); },
+         [&target](const MeshAsset &asset) { target = uploadMesh(asset); });
+  }
+
+  /**
+   * Uploads finished assets on the calling (GL) thread, at least one if there is any and then
+   * more until `budget_seconds` are spent, so a burst of completions does not stall a frame.
+   */
+  void poll(double budget_seconds = 0.004) {
+    auto start = std::chrono::steady_clock::now();
+    do {
+      Job job;
+      bool inline_read = false;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::deque<Job> &source = (threads_.empty() ? queued_ : ready_);
+        if (source.empty())
+          return;
+        job = std::move(source.front());
+        source.pop_front();
+        inline_read = threads_.empty();
+      }
+      if (inline_read)
+        job.read();
+      job.upload();
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_--;
+    } while (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < budget_seconds);
+  }
+
+  /**
+   * Assets requested but not uploaded yet.
+   */
+  [[nodiscard]] size_t pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_;
+  }
+
+  [[nodiscard]] bool done() const {
+    return pending() == 0;
+  }
+
+ private:
+  struct Job {
+    std::function<void()> read;
+    std::function<void()> upload;
+  };
+
+  std::vector<std::thread> threads_;
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_ = false;
+  std::deque<Job> queued_;
+  std::deque<Job> ready_;
+  size_t pending_ = 0;
+
+  PixelUnpackBuffer staging_;
+
+  void threadLoop() {
+    while (true) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&] { return stop_ || !queued_.empty(); });
+        if (stop_)
+          return;
+        job = std::move(queued_.front());
+        queued_.pop_front();
+      }
+      job.read();
+      std::lock_guard<std::mutex> lock(mutex_);
+      ready_.push_back(std::move(job));
+    }
+  }
+
+  PixelUnpackBuffer *staging() {
+    return (PixelUnpackBuffer::supported() ? &staging_ : nullptr);
+  }
+};
@@ -0,0 +1,59 @@
+// Offline mesh baker: parses and optimizes OBJ files and writes their binary caches
+// (`<file>.meshbin`, `<file>.compact.meshbin`), so the game can map them on the first launch already.
+//
+// usage: bake_mesh [--format full|compact|both] file.obj [file.obj ...]
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "obj_loader.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimize.hpp"
+
+int main(int argc, char **argv) {
+  std::vector<VertexFormat> formats{VertexFormat::full, VertexFormat::compact};
+  int first_file = 1;
+  if (argc > 2 && std::string(argv[1]) == "--format") {
+    std::string format = argv[2];
+    if (format == "full")
+      formats = {VertexFormat::full};
+    else if (format == "compact")
+      formats = {VertexFormat::compact};
+    else if (format != "both") {
+      std::fprintf(stderr, "unknown format %s, expected full, compact or both\n", format.c_str());
+      return 1;
+    }
+    first_file = 3;
+  }
+  if (first_file >= argc) {
+    std::fprintf(stderr, "usage: %s [--format full|compact|both] file.obj [file.obj ...]\n", argv[0]);
+    return 1;
+  }
+
+  int status = 0;
+  for (int i = first_file; i < argc; i++) {
+    std::string path = argv[i];
+    MappedFile source(path);
+    if (!source.isOpen()) {
+      std::fprintf(stderr, "%s: cannot open\n", path.c_str());
+      status = 1;
+      continue;
+    }
+
+    MeshData data = obj::parse(source.data(), source.data() + source.size());
+    uint64_t source_hash = hashBytes(source.data(), source.size());
+    for (VertexFormat format : formats) {
+      mesh_optimize::Report report;
+      PackedMesh packed = mesh_optimize::build(data, format, &report);
+      std::string cache_path = mesh_cache::cachePath(path, format);
+      if (!mesh_cache::write(cache_path, packed.view(), source_hash)) {
+        std::fprintf(stderr, "%s: cannot write %s\n", path.c_str(), cache_path.c_str());
+        status = 1;
+        continue;
+      }
+      report.print(cache_path);
+    }
+  }
+  return status;
+}
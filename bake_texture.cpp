@@ -0,0 +1,79 @@
+// Offline texture baker: decodes images, builds their mip chains, optionally compresses them
+// to BC1/BC3 and writes the containers (`<file>.texbin`) the game maps instead of decoding.
+// Cube map faces are stored top row first, other textures bottom row first, as GL expects them.
+//
+// usage: bake_texture [--format rgb|bc1|bc3] [--cube] file [file ...]
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "blob.hpp"
+#include "texture_cache.hpp"
+#include "texture_compress.hpp"
+
+int main(int argc, char **argv) {
+  TextureFormat format = TextureFormat::bc1;
+  bool cube = false;
+  std::vector<std::string> paths;
+  bool usage = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--format" && i + 1 < argc) {
+      std::string name = argv[++i];
+      if (name == "rgb")
+        format = TextureFormat::rgb8;
+      else if (name == "bc1")
+        format = TextureFormat::bc1;
+      else if (name == "bc3")
+        format = TextureFormat::bc3;
+      else
+        usage = true;
+    } else if (arg == "--cube") {
+      cube = true;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (usage || paths.empty()) {
+    std::fprintf(stderr, "usage: %s [--format rgb|bc1|bc3] [--cube] file [file ...]\n", argv[0]);
+    return 1;
+  }
+
+  int status = 0;
+  for (const std::string &path : paths) {
+    MappedFile source(path);
+    if (!source.isOpen()) {
+      std::fprintf(stderr, "%s: cannot open\n", path.c_str());
+      status = 1;
+      continue;
+    }
+    uint64_t source_hash = hashBytes(source.data(), source.size());
+
+    bool flipped = !cube;
+    Image image = decodeImage(path, flipped, format == TextureFormat::bc3 ? 4 : 3);
+    EncodedTexture encoded = texture_compress::encode(image, format);
+    if (encoded.levels.size() > MAX_TEXTURE_LEVELS) {
+      std::fprintf(stderr, "%s: %dx%d is too large\n", path.c_str(), image.width, image.height);
+      status = 1;
+      continue;
+    }
+
+    std::string cache_path = texture_cache::cachePath(path);
+    if (!texture_cache::write(cache_path, encoded.view(), flipped, source_hash)) {
+      std::fprintf(stderr, "%s: cannot write %s\n", path.c_str(), cache_path.c_str());
+      status = 1;
+      continue;
+    }
+
+    size_t bytes = 0;
+    for (const auto &level : encoded.levels)
+      bytes += level.bytes.size();
+    size_t uncompressed = (size_t)image.width * image.height * 3 * 4 / 3; // RGB with mipmaps
+    std::printf("%s: %dx%d, %zu levels, %zu bytes (RGB with mipmaps %zu), rmse %.2f\n",
+                cache_path.c_str(), image.width, image.height, encoded.levels.size(), bytes, uncompressed,
+                texture_compress::rmse(image, encoded));
+  }
+  return status;
+}
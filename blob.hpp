@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Helpers for raw byte ranges: the binary cache files and checksums of pixels or sources.
+ */
+
+/**
+ * 64-bit hash of a byte range, 8 bytes per step.
+ */
+inline uint64_t hashBytes(const char *data, size_t size) {
+  constexpr uint64_t MUL = 0x9E3779B97F4A7C15ull;
+  uint64_t h = 0xCBF29CE484222325ull ^ (size * MUL);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + i, 8);
+    h = (h ^ (word * MUL)) * 0x100000001B3ull;
+    h ^= h >> 32;
+  }
+  for (; i < size; i++)
+    h = (h ^ (uint8_t)data[i]) * 0x100000001B3ull;
+
+  // murmur3 finalizer
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDull;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+/**
+ * `value` rounded up to a multiple of `alignment`.
+ */
+inline uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cmath>
+
+#include "controls.hpp"
+
+/**
+ * Deterministic scripted player for headless runs: walks forward, strafes
+ * every few seconds, sweeps the camera around and fires at a fixed rate.
+ */
+class ScriptedBot : public InputSource {
+ public:
+  explicit ScriptedBot(double fire_rate) : fire_rate_(fire_rate) {
+  }
+
+  /**
+   * Advances the script by one tick and returns how many shots to fire during it.
+   */
+  int advance(double elapsed_time) {
+    time_ += elapsed_time;
+    pending_shots_ += elapsed_time * fire_rate_;
+    int shots = (int)pending_shots_;
+    pending_shots_ -= shots;
+    return shots;
+  }
+
+  PlayerControls poll() override {
+    PlayerControls controls;
+    controls.forward = true;
+    controls.right = std::fmod(time_, STRAFE_PERIOD) < STRAFE_DURATION;
+    controls.cursor = {
+        time_ * TURN_SPEED,
+        LOOK_AMPLITUDE * std::sin(time_ * LOOK_FREQUENCY)
+    };
+    return controls;
+  }
+
+ private:
+  // Cursor units per second; the scene does a full turn every 1000 units
+  static constexpr double TURN_SPEED = 60;
+  static constexpr double LOOK_AMPLITUDE = 40;
+  static constexpr double LOOK_FREQUENCY = 0.7;
+  static constexpr double STRAFE_PERIOD = 6;
+  static constexpr double STRAFE_DURATION = 2;
+
+  double fire_rate_;
+  double time_ = 0;
+  double pending_shots_ = 0;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+ * Uniform grid broad phase.
+ *
+ * Points are bucketed into cubic cells by hashing the integer cell coordinates
+ * into a power-of-two table. Buckets are laid out contiguously with a counting
+ * sort, so a rebuild is O(n) and does not allocate once the buffers are warm.
+ */
+class SpatialHash {
+ public:
+  explicit SpatialHash(float cell_size)
+        : cell_size_(cell_size)
+        , inv_cell_size_(1.0f / cell_size) {
+  }
+
+  void build(const glm::vec3 *points, size_t count) {
+    size_t table_size = 1;
+    while (table_size < count * 2)
+      table_size *= 2;
+    mask_ = table_size - 1;
+
+    bucket_of_.resize(count);
+    bucket_start_.assign(table_size + 1, 0);
+    for (size_t i = 0; i < count; i++) {
+      bucket_of_[i] = bucketOf(cellOf(points[i]));
+      bucket_start_[bucket_of_[i] + 1]++;
+    }
+    for (size_t b = 0; b < table_size; b++)
+      bucket_start_[b + 1] += bucket_start_[b];
+
+    sorted_.resize(count);
+    xs_.resize(count);
+    ys_.resize(count);
+    zs_.resize(count);
+    cursor_.assign(bucket_start_.begin(), bucket_start_.end() - 1);
+    for (size_t i = 0; i < count; i++) {
+      uint32_t at = cursor_[bucket_of_[i]]++;
+      sorted_[at] = (uint32_t)i;
+      xs_[at] = points[i].x;
+      ys_[at] = points[i].y;
+      zs_[at] = points[i].z;
+    }
+  }
+
+  /**
+   * Calls f(index) for every point whose cell overlaps the cube around `center`.
+   * Cells that hash into the same bucket are visited once, so as long as the cube
+   * spans at most 3 cells per axis an index is never reported twice.
+   */
+  template <typename TFunc>
+  void query(const glm::vec3 &center, float radius, TFunc f) const {
+    queryBlocks(center, radius, [&](const uint32_t *indices, const float *, const float *, const float *, size_t count) {
+      for (size_t i = 0; i < count; i++)
+        f((size_t)indices[i]);
+    });
+  }
+
+  /**
+   * Same as query(), but reports whole buckets at once for batch processing:
+   * f(indices, xs, ys, zs, count) gets the point indices (ascending) and their coordinates as separate arrays.
+   */
+  template <typename TFunc>
+  void queryBlocks(const glm::vec3 &center, float radius, TFunc f) const {
+    if (sorted_.empty())
+      return;
+
+    glm::ivec3 lo = cellOf(center - glm::vec3(radius));
+    glm::ivec3 hi = cellOf(center + glm::vec3(radius));
+
+    uint32_t visited[MAX_QUERY_BUCKETS];
+    size_t visited_count = 0;
+
+    for (int x = lo.x; x <= hi.x; x++) {
+      for (int y = lo.y; y <= hi.y; y++) {
+        for (int z = lo.z; z <= hi.z; z++) {
+          uint32_t bucket = bucketOf({x, y, z});
+
+          bool seen = false;
+          for (size_t i = 0; i < visited_count && !seen; i++)
+            seen = (visited[i] == bucket);
+          if (seen)
+            continue;
+          if (visited_count < MAX_QUERY_BUCKETS)
+            visited[visited_count++] = bucket;
+
+          uint32_t begin = bucket_start_[bucket];
+          uint32_t end = bucket_start_[bucket + 1];
+          if (begin != end)
+            f(&sorted_[begin], &xs_[begin], &ys_[begin], &zs_[begin], (size_t)(end - begin));
+        }
+      }
+    }
+  }
+
+  [[nodiscard]] float cellSize() const {
+    return cell_size_;
+  }
+
+ private:
+  // Enough for a query cube spanning 3 cells per axis (radius up to 1.5 cells).
+  static constexpr size_t MAX_QUERY_BUCKETS = 27;
+
+  [[nodiscard]] glm::ivec3 cellOf(const glm::vec3 &p) const {
+    return {
+        (int)std::floor(p.x * inv_cell_size_),
+        (int)std::floor(p.y * inv_cell_size_),
+        (int)std::floor(p.z * inv_cell_size_)
+    };
+  }
+
+  [[nodiscard]] uint32_t bucketOf(const glm::ivec3 &cell) const {
+    uint32_t h = ((uint32_t)cell.x * 73856093u) ^ ((uint32_t)cell.y * 19349663u) ^ ((uint32_t)cell.z * 83492791u);
+    return h & mask_;
+  }
+
+  float cell_size_;
+  float inv_cell_size_;
+  uint32_t mask_ = 0;
+
+  std::vector<uint32_t> bucket_of_;
+  std::vector<uint32_t> bucket_start_;
+  std::vector<uint32_t> cursor_;
+  std::vector<uint32_t> sorted_;
+  std::vector<float> xs_, ys_, zs_;
+};
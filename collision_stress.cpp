@@ -0,0 +1,135 @@
+// Collision stress mode: fills a scene with N enemies and N projectiles at a
+// constant density and times Scene::checkCollisions for growing N.
+// With the grid broad phase the cost per entity should stay roughly flat.
+//
+// usage: collision_stress [max_entities] [brute_force_limit]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "world.hpp"
+
+static std::vector<QuatTransform> scatter(size_t count, float half_extent, float height, std::default_random_engine &rng) {
+  std::uniform_real_distribution<float> coord(-half_extent, half_extent);
+  std::uniform_real_distribution<float> angle(-glm::pi<float>(), glm::pi<float>());
+  std::vector<QuatTransform> result;
+  result.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    float x = coord(rng);
+    float z = coord(rng);
+    result.push_back(QuatTransform{{x, height, z}, glm::angleAxis(angle(rng), glm::vec3{0, 1, 0})});
+  }
+  return result;
+}
+
+/**
+ * Positions of the entities left alive, in a canonical order, so two implementations can be
+ * compared by who they killed rather than how many.
+ */
+struct Survivors {
+  std::vector<glm::vec3> enemies;
+  std::vector<glm::vec3> projectiles;
+
+  void sort() {
+    auto less = [](const glm::vec3 &a, const glm::vec3 &b) {
+      return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z);
+    };
+    std::sort(enemies.begin(), enemies.end(), less);
+    std::sort(projectiles.begin(), projectiles.end(), less);
+  }
+
+  bool operator==(const Survivors &other) const {
+    return enemies == other.enemies && projectiles == other.projectiles;
+  }
+};
+
+// The pre-grid implementation: all pairs, erase on hit.
+static int bruteForce(std::vector<QuatTransform> enemies, std::vector<QuatTransform> projectiles, Survivors &survivors) {
+  int killed = 0;
+  for (size_t ip = 0; ip < projectiles.size(); ip++) {
+    for (size_t ie = 0; ie < enemies.size(); ie++) {
+      if (Scene::checkCollision(projectiles[ip].pos, enemies[ie].pos)) {
+        enemies.erase(enemies.begin() + ie);
+        projectiles.erase(projectiles.begin() + ip);
+        killed++;
+        ip--;
+        break;
+      }
+    }
+  }
+  for (const auto &enemy : enemies)
+    survivors.enemies.push_back(enemy.pos);
+  for (const auto &projectile : projectiles)
+    survivors.projectiles.push_back(projectile.pos);
+  survivors.sort();
+  return killed;
+}
+
+int main(int argc, char **argv) {
+  size_t max_entities = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 17);
+  size_t brute_force_limit = (argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1 << 13);
+
+  // Roughly one enemy per 25 square units, so the number of neighbours per query stays constant
+  constexpr float AREA_PER_ENEMY = 25;
+  constexpr int RUNS = 5;
+
+  IdleInput input;
+  std::default_random_engine rng(42);
+  int failures = 0;
+
+  std::printf("%10s %10s %14s %14s %14s %10s\n", "entities", "killed", "grid ms", "grid ns/ent", "all-pairs ms", "same");
+  for (size_t n = 1024; n <= max_entities; n *= 2) {
+    float half_extent = std::sqrt(n * AREA_PER_ENEMY) / 2;
+    auto enemies = scatter(n, half_extent, 0.0f, rng);
+    auto projectiles = scatter(n, half_extent, 1.0f, rng);
+
+    double grid_seconds = 0;
+    int killed = 0;
+    Survivors survivors;
+    for (int run = 0; run < RUNS; run++) {
+      Scene scene(&input, 42);
+      scene.enemies.reserve(n);
+      scene.projectiles.reserve(n);
+      for (const auto &enemy : enemies)
+        scene.enemies.add(enemy);
+      for (const auto &projectile : projectiles)
+        scene.projectiles.add(projectile, glm::vec3{0, 0, 0});
+
+      auto start = std::chrono::steady_clock::now();
+      scene.checkCollisions();
+      grid_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      killed = scene.killed_count;
+      if (run == RUNS - 1) {
+        survivors.enemies = scene.enemies.pos;
+        survivors.projectiles = scene.projectiles.pos;
+        survivors.sort();
+      }
+    }
+    grid_seconds /= RUNS;
+
+    double brute_seconds = -1;
+    bool same = true;
+    if (n <= brute_force_limit) {
+      Survivors brute_survivors;
+      auto start = std::chrono::steady_clock::now();
+      int brute_killed = bruteForce(enemies, projectiles, brute_survivors);
+      brute_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      same = (brute_killed == killed && brute_survivors == survivors);
+      if (!same)
+        std::fprintf(stderr, "killed sets differ at %zu: grid %d, all-pairs %d killed\n", n, killed, brute_killed);
+      failures += !same;
+    }
+
+    std::printf("%10zu %10d %14.3f %14.1f", n, killed, grid_seconds * 1e3, grid_seconds * 1e9 / (2 * n));
+    if (brute_seconds >= 0)
+      std::printf(" %14.3f %10s\n", brute_seconds * 1e3, (same ? "ok" : "FAIL"));
+    else
+      std::printf(" %14s %10s\n", "-", "-");
+  }
+  return failures == 0 ? 0 : 1;
+}
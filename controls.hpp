@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/**
+ * Player controls sampled once per simulation tick.
+ * `cursor` is an accumulated position, the scene turns the player by its delta.
+ */
+struct PlayerControls {
+  bool forward = false;
+  bool backward = false;
+  bool left = false;
+  bool right = false;
+  bool slow = false;
+  glm::vec2 cursor{0, 0};
+};
+
+/**
+ * Where the scene gets player controls from: a window, a bot, a recording...
+ */
+class InputSource {
+ public:
+  virtual ~InputSource() = default;
+  virtual PlayerControls poll() = 0;
+};
+
+/**
+ * Nothing pressed, cursor never moves.
+ */
+class IdleInput : public InputSource {
+ public:
+  PlayerControls poll() override {
+    return {};
+  }
+};
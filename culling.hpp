@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "kernels.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * Bounding sphere culling against the view frustum.
+ *
+ * Spheres are gathered in structure-of-arrays form and tested in SIMD batches with
+ * SimdKernels::spheresInFrustum; large sets are split over a ThreadPool.
+ * Per frame: begin(view_projection), add(...) every sphere, then cull().
+ */
+class FrustumCuller {
+ public:
+  // Spheres per task; smaller sets are tested on the calling thread
+  static constexpr size_t PARALLEL_BATCH = 4096;
+
+  void begin(const glm::mat4 &view_projection) {
+    // Gribb-Hartmann: each plane is the last row of the matrix plus or minus another row
+    for (int axis = 0; axis < 3; axis++) {
+      for (int side = 0; side < 2; side++) {
+        glm::vec4 plane;
+        for (int column = 0; column < 4; column++) {
+          float row = view_projection[column][axis];
+          plane[column] = view_projection[column][3] + (side == 0 ? row : -row);
+        }
+        planes_[axis * 2 + side] = plane / glm::length(glm::vec3(plane));
+      }
+    }
+    xs_.clear();
+    ys_.clear();
+    zs_.clear();
+    radii_.clear();
+  }
+
+  void add(const glm::vec3 &center, float radius) {
+    xs_.push_back(center.x);
+    ys_.push_back(center.y);
+    zs_.push_back(center.z);
+    radii_.push_back(radius);
+  }
+
+  [[nodiscard]] size_t size() const {
+    return xs_.size();
+  }
+
+  /**
+   * Indices (in add order, ascending) of the spheres that may be visible.
+   */
+  const std::vector<uint32_t> &cull(ThreadPool &pool) {
+    size_t count = size();
+    visible_mask_.resize(count);
+    size_t batches = (count + PARALLEL_BATCH - 1) / PARALLEL_BATCH;
+    pool.parallelFor(batches, [&](size_t batch) {
+      size_t start = batch * PARALLEL_BATCH;
+      size_t length = std::min(PARALLEL_BATCH, count - start);
+      simdKernels().spheresInFrustum(planes_, &xs_[start], &ys_[start], &zs_[start], &radii_[start],
+                                     length, &visible_mask_[start]);
+    });
+
+    visible_.clear();
+    for (size_t i = 0; i < count; i++) {
+      if (visible_mask_[i])
+        visible_.push_back((uint32_t)i);
+    }
+    return visible_;
+  }
+
+  [[nodiscard]] const std::vector<uint32_t> &visible() const {
+    return visible_;
+  }
+
+  [[nodiscard]] size_t culledCount() const {
+    return size() - visible_.size();
+  }
+
+ private:
+  glm::vec4 planes_[6];
+  std::vector<float> xs_, ys_, zs_, radii_;
+  std::vector<uint8_t> visible_mask_;
+  std::vector<uint32_t> visible_;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+ * Stable reference to an entity inside an EntityStore.
+ * Stays valid while other entities are added or removed, goes stale once its own entity is removed.
+ */
+struct EntityHandle {
+  uint32_t slot = std::numeric_limits<uint32_t>::max();
+  uint32_t generation = 0;
+
+  bool operator==(const EntityHandle& other) const {
+    return slot == other.slot && generation == other.generation;
+  }
+  bool operator!=(const EntityHandle& other) const {
+    return !(*this == other);
+  }
+};
+
+/**
+ * Dense structure-of-arrays entity storage.
+ *
+ * A derived store keeps one std::vector per component and exposes them via
+ * forEachColumn(f); all columns are indexed by the same dense index.
+ * Removal moves the last entity into the hole (swap-and-pop), so dense indices
+ * are not stable - use handles to refer to an entity across ticks.
+ */
+template <typename Derived>
+class EntityStore {
+ public:
+  [[nodiscard]] size_t size() const {
+    return dense_to_slot_.size();
+  }
+
+  [[nodiscard]] bool empty() const {
+    return dense_to_slot_.empty();
+  }
+
+  [[nodiscard]] EntityHandle handle(size_t index) const {
+    uint32_t slot = dense_to_slot_[index];
+    return {slot, generation_[slot]};
+  }
+
+  [[nodiscard]] bool contains(EntityHandle h) const {
+    return h.slot < generation_.size() && generation_[h.slot] == h.generation;
+  }
+
+  /**
+   * Dense index of the entity, or size() if the handle is stale.
+   */
+  [[nodiscard]] size_t find(EntityHandle h) const {
+    return contains(h) ? slot_to_dense_[h.slot] : size();
+  }
+
+  void remove(size_t index) {
+    size_t last = size() - 1;
+    derived().forEachColumn([&](auto& column) {
+      column[index] = std::move(column[last]);
+      column.pop_back();
+    });
+
+    uint32_t removed_slot = dense_to_slot_[index];
+    uint32_t moved_slot = dense_to_slot_[last];
+    dense_to_slot_[index] = moved_slot;
+    slot_to_dense_[moved_slot] = index;
+    dense_to_slot_.pop_back();
+
+    generation_[removed_slot]++;
+    free_slots_.push_back(removed_slot);
+  }
+
+  void remove(EntityHandle h) {
+    if (contains(h))
+      remove(find(h));
+  }
+
+  void clear() {
+    while (!empty())
+      remove(size() - 1);
+  }
+
+  void reserve(size_t count) {
+    derived().forEachColumn([&](auto& column) {
+      column.reserve(count);
+    });
+    dense_to_slot_.reserve(count);
+  }
+
+ protected:
+  /**
+   * Registers an entity whose components were just pushed to the back of every column.
+   */
+  EntityHandle allocate() {
+    uint32_t slot;
+    if (!free_slots_.empty()) {
+      slot = free_slots_.back();
+      free_slots_.pop_back();
+    } else {
+      slot = (uint32_t)generation_.size();
+      generation_.push_back(0);
+      slot_to_dense_.push_back(0);
+    }
+    slot_to_dense_[slot] = (uint32_t)dense_to_slot_.size();
+    dense_to_slot_.push_back(slot);
+    return {slot, generation_[slot]};
+  }
+
+ private:
+  Derived& derived() {
+    return static_cast<Derived&>(*this);
+  }
+
+  std::vector<uint32_t> dense_to_slot_;
+  std::vector<uint32_t> slot_to_dense_;
+  std::vector<uint32_t> generation_;
+  std::vector<uint32_t> free_slots_;
+};
@@ -0,0 +1,101 @@
+// Expiry stress mode: fills a scene with N live projectiles and N dying objects
+// and times Scene::clearMemory over ticks where nothing expires, for growing N.
+// No timer is due or cascades inside the measured ticks, so the wheel does the same
+// work per tick at any N; its cost still grows some with N because the rest of the
+// update pushes the wheel out of the cache, but levels off at memory latency, unlike
+// the old per-entity scan, which grows linearly and is timed alongside for reference.
+// Fails when the wheel's cost per tick grows past MAX_COST_RATIO.
+//
+// usage: expiry_stress [max_entities]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "world.hpp"
+
+// The pre-timer implementation's checks, counting instead of removing
+static size_t scanExpired(const Scene &scene, double game_time) {
+  size_t expired = 0;
+  for (size_t ip = 0; ip < scene.projectiles.size(); ip++)
+    expired += glm::length(scene.projectiles.pos[ip] - scene.player.pos) > 100;
+  for (size_t id = 0; id < scene.dying_objects.size(); id++)
+    expired += game_time - scene.dying_objects.death_start[id] > scene.dying_objects.death_duration;
+  return expired;
+}
+
+int main(int argc, char **argv) {
+  size_t max_entities = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 17);
+
+  constexpr double DT = 1.0 / 60;
+  constexpr int TICKS = 30; // half a second, well inside both lifetimes
+  // Between the largest and the smallest N the wheel's cost per tick may grow this much; by
+  // default N grows 128 times, which a cost per timer would follow
+  constexpr double MAX_COST_RATIO = 16;
+
+  IdleInput input;
+  std::default_random_engine rng(42);
+  std::uniform_real_distribution<float> coord(-50.0f, 50.0f);
+  int failures = 0;
+  double min_wheel_seconds = 0, max_wheel_seconds = 0;
+
+  std::printf("%10s %10s %10s %16s %16s %10s\n", "entities", "timers", "expired", "wheel ns/tick", "scan ns/tick", "cleared");
+  for (size_t n = 1024; n <= max_entities; n *= 2) {
+    SceneConfig config;
+    config.max_enemies = 0;
+    Scene scene(&input, 42, config);
+    scene.enemies.reserve(n / 2);
+    scene.projectiles.reserve(n);
+    scene.dying_objects.reserve(n);
+
+    // Pairs of an enemy and a projectile inside it die on the first tick: n dying objects.
+    // Still projectiles above everyone's heads are the other n.
+    for (size_t i = 0; i < n / 2; i++) {
+      glm::vec3 pos{coord(rng) * 10, 0, coord(rng) * 10};
+      scene.enemies.add(QuatTransform{pos, glm::quat(1, 0, 0, 0)});
+      scene.spawnProjectile(QuatTransform{pos + Scene::PERSON_HEAD * 0.5f, glm::quat(1, 0, 0, 0)}, glm::vec3{0});
+    }
+    for (size_t i = 0; i < n; i++)
+      scene.spawnProjectile(QuatTransform{{coord(rng), 50, coord(rng)}, glm::quat(1, 0, 0, 0)}, glm::vec3{0});
+
+    double game_time = DT;
+    scene.update(DT);
+    size_t timers = scene.pendingTimers();
+
+    scene.measure_phases = true;
+    for (int tick = 0; tick < TICKS; tick++) {
+      game_time += DT;
+      scene.update(DT);
+    }
+    double wheel_seconds = scene.phase_seconds[(size_t)Scene::Phase::clear_memory] / TICKS;
+    min_wheel_seconds = (n == 1024 ? wheel_seconds : std::min(min_wheel_seconds, wheel_seconds));
+    max_wheel_seconds = std::max(max_wheel_seconds, wheel_seconds);
+
+    size_t expired = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < TICKS; tick++)
+      expired += scanExpired(scene, game_time);
+    double scan_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / TICKS;
+
+    size_t entities = scene.projectiles.size() + scene.dying_objects.size();
+    // Past the end of the death animations, the dying objects must all be gone
+    while (game_time < 1.5) {
+      game_time += DT;
+      scene.update(DT);
+    }
+    bool cleared = scene.dying_objects.empty() && scene.projectiles.size() == n;
+    failures += !cleared || expired != 0;
+
+    std::printf("%10zu %10zu %10zu %16.1f %16.1f %10s\n", entities, timers, expired / TICKS,
+                wheel_seconds * 1e9, scan_seconds * 1e9, (cleared ? "ok" : "FAIL"));
+  }
+
+  double cost_ratio = max_wheel_seconds / min_wheel_seconds;
+  bool bounded = (cost_ratio <= MAX_COST_RATIO);
+  failures += !bounded;
+  std::printf("wheel cost ratio: %.1f (at most %.0f) %s\n", cost_ratio, MAX_COST_RATIO, (bounded ? "ok" : "FAIL"));
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+/**
+ * How the main loop waits between frames:
+ * vsync    - the swap blocks until the display refresh (swap interval 1), no extra waiting
+ * fixed    - swap interval 0, wait until the next tick of a fixed period: sleep for most of
+ *            it, then spin the rest, since a sleep can overshoot by a scheduler quantum
+ * uncapped - swap interval 0, no waiting, for throughput benchmarks
+ */
+enum class PacingMode { vsync, fixed, uncapped };
+
+inline bool parsePacingMode(const std::string &name, PacingMode &mode) {
+  if (name == "vsync")
+    mode = PacingMode::vsync;
+  else if (name == "fixed")
+    mode = PacingMode::fixed;
+  else if (name == "uncapped")
+    mode = PacingMode::uncapped;
+  else
+    return false;
+  return true;
+}
+
+inline const char *pacingModeName(PacingMode mode) {
+  switch (mode) {
+    case PacingMode::vsync: return "vsync";
+    case PacingMode::fixed: return "fixed";
+    case PacingMode::uncapped: return "uncapped";
+  }
+  return "";
+}
+
+/**
+ * Paces the frames and measures how regular they are. Call frameDone() once per frame right
+ * after the buffer swap; it waits as the mode requires and records the frame interval.
+ *
+ * The fixed mode keeps absolute deadlines (previous deadline + period), so an early or late
+ * frame does not shift the ones after it; a frame more than a period late resynchronizes.
+ * The spin margin adapts to how much sleeps have overshot recently.
+ */
+class FramePacer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t HISTORY = 240; // frames
+
+  /**
+   * `target_fps` is the fixed mode's rate, and for vsync the refresh rate deadlines are checked against.
+   */
+  FramePacer(PacingMode mode, double target_fps)
+      : mode_(mode), period_(1.0 / std::max(target_fps, 1.0)) {
+  }
+
+  [[nodiscard]] PacingMode mode() const {
+    return mode_;
+  }
+
+  /**
+   * For glfwSwapInterval.
+   */
+  [[nodiscard]] int swapInterval() const {
+    return mode_ == PacingMode::vsync ? 1 : 0;
+  }
+
+  [[nodiscard]] double period() const {
+    return period_;
+  }
+
+  void frameDone() {
+    if (mode_ == PacingMode::fixed)
+      waitForDeadline();
+
+    Clock::time_point now = Clock::now();
+    double interval = seconds(now - last_frame_);
+    last_frame_ = now;
+    if (!started_) {
+      started_ = true; // the first interval includes startup
+      return;
+    }
+    intervals_[next_] = interval;
+    next_ = (next_ + 1) % HISTORY;
+    filled_ = std::min(filled_ + 1, HISTORY);
+
+    // Vsync has no deadline of its own; a frame that took more than one refresh missed one
+    if (mode_ == PacingMode::vsync && interval > period_ * 1.5)
+      missed_++;
+  }
+
+  /**
+   * Mean frame interval over the window, in seconds.
+   */
+  [[nodiscard]] double meanInterval() const {
+    double sum = 0;
+    for (size_t i = 0; i < filled_; i++)
+      sum += intervals_[i];
+    return filled_ ? sum / filled_ : 0;
+  }
+
+  /**
+   * Standard deviation of the frame interval over the window, in seconds.
+   */
+  [[nodiscard]] double jitter() const {
+    double mean = meanInterval(), sum = 0;
+    for (size_t i = 0; i < filled_; i++)
+      sum += (intervals_[i] - mean) * (intervals_[i] - mean);
+    return filled_ ? std::sqrt(sum / filled_) : 0;
+  }
+
+  /**
+   * Frames that were ready only after their deadline (fixed), or that spanned more than one refresh (vsync).
+   */
+  [[nodiscard]] uint64_t missedDeadlines() const {
+    return missed_;
+  }
+
+  /**
+   * Seconds left for spinning after a sleep.
+   */
+  [[nodiscard]] double spinMargin() const {
+    return spin_margin_;
+  }
+
+ private:
+  static constexpr double MIN_SPIN_MARGIN = 0.0002;
+  static constexpr double MAX_SPIN_MARGIN = 0.004;
+
+  PacingMode mode_;
+  double period_;
+  Clock::time_point last_frame_;
+  Clock::time_point deadline_;
+  double spin_margin_ = 0.001;
+  double intervals_[HISTORY] = {};
+  size_t next_ = 0;
+  size_t filled_ = 0;
+  uint64_t missed_ = 0;
+  bool started_ = false;
+
+  static double seconds(Clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+  }
+
+  void waitForDeadline() {
+    if (!started_) {
+      deadline_ = Clock::now();
+      return;
+    }
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period_));
+    deadline_ += period;
+    Clock::time_point now = Clock::now();
+    if (now > deadline_) {
+      missed_++;
+      if (now - deadline_ > period)
+        deadline_ = now;
+      return;
+    }
+
+    double sleep = seconds(deadline_ - now) - spin_margin_;
+    if (sleep > 0) {
+      Clock::time_point before = now;
+      std::this_thread::sleep_for(std::chrono::duration<double>(sleep));
+      double overshoot = seconds(Clock::now() - before) - sleep;
+      // Jump up to a worse overshoot at once, decay slowly back down
+      double wanted = overshoot * 1.25 + MIN_SPIN_MARGIN;
+      spin_margin_ = std::clamp(wanted > spin_margin_ ? wanted : spin_margin_ * 0.95 + wanted * 0.05,
+                                MIN_SPIN_MARGIN, MAX_SPIN_MARGIN);
+    }
+    while (Clock::now() < deadline_)
+      std::this_thread::yield();
+  }
+};
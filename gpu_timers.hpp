@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "profiler.hpp"
+
+/**
+ * GPU pass timing with GL_TIMESTAMP queries, reported to a Profiler on its GPU track.
+ *
+ * Each frame's queries are read back FRAMES frames later, by which time the GPU has normally
+ * finished them, so reading never stalls the pipeline; results still not available then are
+ * dropped. GPU timestamps are mapped to the profiler's clock with an offset measured each
+ * frame, close enough to line passes up with the CPU scopes in a trace.
+ * Scopes must not nest. Needs GL 3.3 or ARB_timer_query; elsewhere they do nothing, and in
+ * WebGL, which lacks these queries, the GL calls are compiled out.
+ */
+class GpuTimers {
+ public:
+  static constexpr int FRAMES = 4;
+  static constexpr size_t MAX_SCOPES = 32; // per frame
+
+  static bool supported() {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+#endif
+  }
+
+  /**
+   * Times the GPU work issued during its lifetime.
+   */
+  class Scope {
+   public:
+    Scope(GpuTimers *timers, const char *name) : timers_(timers) {
+      if (timers_ && !timers_->begin(name))
+        timers_ = nullptr;
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() {
+      if (timers_)
+        timers_->end();
+    }
+
+   private:
+    GpuTimers *timers_;
+  };
+
+  explicit GpuTimers(Profiler &profiler) : profiler_(profiler), enabled_(supported()) {
+#ifndef __EMSCRIPTEN__
+    if (!enabled_)
+      return;
+    for (Frame &frame : frames_) {
+      frame.queries.resize(2 * MAX_SCOPES);
+      glGenQueries((GLsizei)frame.queries.size(), frame.queries.data());
+    }
+#endif
+  }
+
+  GpuTimers(const GpuTimers&) = delete;
+  GpuTimers& operator=(const GpuTimers&) = delete;
+
+  ~GpuTimers() {
+#ifndef __EMSCRIPTEN__
+    for (Frame &frame : frames_)
+      glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+#endif
+  }
+
+  [[nodiscard]] bool enabled() const {
+    return enabled_;
+  }
+
+  /**
+   * Results dropped because the GPU had not finished them FRAMES frames later.
+   */
+  [[nodiscard]] uint64_t dropped() const {
+    return dropped_;
+  }
+
+  [[nodiscard]] Scope scope(const char *name) {
+    return Scope(enabled_ ? this : nullptr, name);
+  }
+
+  /**
+   * Reports the oldest frame's results and reuses its queries for the frame that starts.
+   */
+  void beginFrame() {
+    if (!enabled_)
+      return;
+#ifndef __EMSCRIPTEN__
+    current_ = (current_ + 1) % FRAMES;
+    Frame &frame = frames_[current_];
+
+    GLint64 gpu_now = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+    int64_t offset = profiler_.now() - gpu_now;
+
+    for (size_t i = 0; i < frame.names.size(); i++) {
+      GLuint available = 0;
+      glGetQueryObjectuiv(frame.queries[2 * i + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) {
+        dropped_++;
+        continue;
+      }
+      GLuint64 start = 0, end = 0;
+      glGetQueryObjectui64v(frame.queries[2 * i], GL_QUERY_RESULT, &start);
+      glGetQueryObjectui64v(frame.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+      profiler_.record(frame.names[i], Profiler::Track::gpu, (int64_t)start + offset, (int64_t)end + offset);
+    }
+    frame.names.clear();
+#endif
+  }
+
+ private:
+  struct Frame {
+    std::vector<GLuint> queries; // begin/end pairs
+    std::vector<const char*> names;
+  };
+
+  Profiler &profiler_;
+  bool enabled_;
+  Frame frames_[FRAMES];
+  int current_ = 0;
+  uint64_t dropped_ = 0;
+
+  bool begin(const char *name) {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    Frame &frame = frames_[current_];
+    if (frame.names.size() == MAX_SCOPES)
+      return false;
+    glQueryCounter(frame.queries[2 * frame.names.size()], GL_TIMESTAMP);
+    frame.names.push_back(name);
+    return true;
+#endif
+  }
+
+  void end() {
+#ifndef __EMSCRIPTEN__
+    Frame &frame = frames_[current_];
+    glQueryCounter(frame.queries[2 * frame.names.size() - 1], GL_TIMESTAMP);
+#endif
+  }
+};
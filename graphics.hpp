@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <optional>
+
 #include <GL/glew.h>
 
 #include <GLFW/glfw3.h>
@@ -15,6 +18,14 @@ using namespace glm;
 #include "shader.hpp"
 #include "utils.hpp"
 #include "mesh.hpp"
+#include "stream_buffer.hpp"
+#include "lighting.hpp"
+#include "culling.hpp"
+#include "thread_pool.hpp"
+#include "assets.hpp"
+#include "profiler.hpp"
+#include "gpu_timers.hpp"
+#include "render_queue.hpp"
 
 #ifdef __EMSCRIPTEN__
 constexpr bool IS_EMSCRIPTEN = true;
@@ -22,241 +33,671 @@ constexpr bool IS_EMSCRIPTEN = true;
 constexpr bool IS_EMSCRIPTEN = false;
 #endif
 
+struct GraphicsOptions {
+  // Quantized 16-byte vertices for the loaded models; WebGL 1 has no half floats
+  bool compact_vertices = !IS_EMSCRIPTEN;
+  // One instanced draw per mesh instead of one draw per entity; WebGL 1 has no instancing
+  bool instancing = !IS_EMSCRIPTEN;
+  // Simplified meshes for distant entities
+  bool lod = true;
+};
+
+/**
+ * std140 layout of the `Frame` uniform block.
+ */
+struct FrameData {
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::vec4 cluster_params; // viewport width, height, first and last light slice depth
+};
+static_assert(sizeof(FrameData) == 2 * 64 + 16);
+
+// Texture units of the clustered light lists; unit 0 is the material texture
+constexpr int LIGHTS_TEXTURE_UNIT = 1;
+constexpr int LIGHT_GRID_TEXTURE_UNIT = 2;
+constexpr int LIGHT_INDICES_TEXTURE_UNIT = 3;
+
+constexpr uint FRAME_BLOCK_BINDING = 0;
+
+/**
+ * Uniform handles of the programs that draw lit, textured meshes.
+ */
+struct ModelUniforms {
+  Uniform<glm::mat4> model;
+  Uniform<float> ambient;
+  Uniform<int> texture;
+  Uniform<glm::vec3> explosion_pos;
+  Uniform<glm::vec3> explosion_dir;
+  Uniform<float> explosion_time;
+  Uniform<float> explosion_total_time;
+  Uniform<int> lights;
+  Uniform<int> light_grid;
+  Uniform<int> light_indices;
+
+  // Only the GLSL 100 shaders, which have no uniform blocks, have these
+  Uniform<glm::mat4> view;
+  Uniform<glm::mat4> projection;
+
+  explicit ModelUniforms(const ShaderProgram &program)
+      : model(program.uniform<glm::mat4>("M")),
+        ambient(program.uniform<float>("ambientK")),
+        texture(program.uniform<int>("tex")),
+        explosion_pos(program.uniform<glm::vec3>("explosionPos_world")),
+        explosion_dir(program.uniform<glm::vec3>("explosionDir_world")),
+        explosion_time(program.uniform<float>("explosionTime")),
+        explosion_total_time(program.uniform<float>("explosionTotalTime")),
+        lights(program.uniform<int>("lights")),
+        light_grid(program.uniform<int>("light_grid")),
+        light_indices(program.uniform<int>("light_indices")),
+        view(program.uniform<glm::mat4>("V")),
+        projection(program.uniform<glm::mat4>("P")) {
+    program.bindBlock("Frame", FRAME_BLOCK_BINDING);
+    if (program.valid()) {
+      program.use();
+      texture.set(0);
+      lights.set(LIGHTS_TEXTURE_UNIT);
+      light_grid.set(LIGHT_GRID_TEXTURE_UNIT);
+      light_indices.set(LIGHT_INDICES_TEXTURE_UNIT);
+    }
+  }
+};
+
 struct Graphics {
+  GraphicsOptions options;
+
+  explicit Graphics(GraphicsOptions options_ = {}) : options(options_) {
+    skybox_program.bindBlock("Frame", FRAME_BLOCK_BINDING);
+
+    assets.mesh(roma_mesh, "./data/roma_smol.obj", modelFormat(), true);
+    assets.texture(roma_texture, "./data/roma_smol.jpg");
+    assets.mesh(projectile_mesh, "./data/projectile.obj", modelFormat(), true);
+    assets.texture(projectile_texture, "./data/projectile.jpg");
+    assets.cubemap(skybox_texture, {
+      "./data/skybox/posx.jpg",
+      "./data/skybox/negx.jpg",
+      "./data/skybox/posy.jpg",
+      "./data/skybox/negy.jpg",
+      "./data/skybox/posz.jpg",
+      "./data/skybox/negz.jpg",
+    });
+    assets.texture(ground_texture, "./data/ground_col.jpg");
+  }
+
   // Fixed FPS
-  uint shader_program = createShaderProgram(
+  ShaderProgram shader_program{
     (IS_EMSCRIPTEN ? "./shaders/vertex_es.glsl"   : "./shaders/vertex.glsl"),
     (IS_EMSCRIPTEN ? "./shaders/fragment_es.glsl" : "./shaders/fragment.glsl"),
-    (IS_EMSCRIPTEN ? "doesnotexist"               : "./shaders/geometry.glsl")
-  );
+    "",
+    modelDefines()
+  };
+  ModelUniforms shader_uniforms{shader_program};
+
+  // Dying objects, drawn with Mesh::drawExploded; the GLSL 100 path draws them intact
+  ShaderProgram explosion_program = modelVariant("#define EXPLODING\n");
+  ModelUniforms explosion_uniforms{explosion_program};
 
-  uint skybox_shader_program = createShaderProgram(
+  ShaderProgram instanced_shader_program = modelVariant("#define INSTANCED\n");
+  ModelUniforms instanced_uniforms{instanced_shader_program};
+
+  ShaderProgram instanced_explosion_program = modelVariant("#define INSTANCED\n#define EXPLODING\n");
+  ModelUniforms instanced_explosion_uniforms{instanced_explosion_program};
+
+  ShaderProgram skybox_program{
       "./shaders/skybox_vertex.glsl",
       "./shaders/skybox_fragment.glsl"
-  );
+  };
 
-  uint ground_shader_program =
-      createShaderProgram(
+  ShaderProgram ground_program{
       "./shaders/ground_vertex.glsl",
       "./shaders/fragment.glsl"
-  );
+  };
+  ModelUniforms ground_uniforms{ground_program};
+
+  // Frame uniforms and instances
+  StreamBuffer stream;
+
+  Profiler profiler;
+  GpuTimers gpu_timers{profiler};
+
+  ThreadPool workers;
+  FrustumCuller culler;
+#ifndef __EMSCRIPTEN__
+  // The GLSL 100 shaders do not read the light clusters, and WebGL 1 has no buffer textures
+  LightClusters light_clusters;
+  BufferTexture lights_texture{GL_RGBA32F};
+  BufferTexture light_grid_texture{GL_RG32UI};
+  BufferTexture light_indices_texture{GL_R32UI};
+#endif
 
-  Mesh roma_mesh = loadSimpleObj("./data/roma_smol.obj");
-  uint roma_texture = loadTexture("./data/roma_smol.jpg");
+  // Placeholders until the loader replaces them, see the constructor
+  Mesh roma_mesh = genPlaceholderMesh();
+  uint roma_texture = createTexture(GL_TEXTURE_2D);
 
-  Mesh projectile_mesh = loadSimpleObj("./data/projectile.obj");
-  uint projectile_texture = loadTexture("./data/projectile.jpg");
+  Mesh projectile_mesh = genPlaceholderMesh();
+  uint projectile_texture = createTexture(GL_TEXTURE_2D);
 
   Mesh skybox_mesh = genCube();
-  uint skybox_texture = loadCubemap({
-    "./data/skybox/posx.jpg",
-    "./data/skybox/negx.jpg",
-    "./data/skybox/posy.jpg",
-    "./data/skybox/negy.jpg",
-    "./data/skybox/posz.jpg",
-    "./data/skybox/negz.jpg",
-  });
+  uint skybox_texture = createTexture(GL_TEXTURE_CUBE_MAP, 0x000066);
 
   Mesh ground_mesh = genSquareSurface();
-  uint ground_texture = loadTexture("./data/ground_col.jpg");
+  uint ground_texture = createTexture(GL_TEXTURE_2D);
+
+  // Declared after the placeholders it replaces, so its threads stop before they are destroyed
+  AssetLoader assets;
 
   GLFWwindow *window;
   int width, height;
 
+  // Draw calls issued by the last drawScene
+  int draw_calls = 0;
+  // Program and texture binds of the entity draws in the last drawScene
+  int state_changes = 0;
+  // Entity triangles submitted by the last drawScene, and what the finest levels would have been
+  size_t triangles = 0;
+  size_t triangles_without_lod = 0;
+
+  [[nodiscard]] bool instancingActive() const {
+    return options.instancing && instanced_shader_program.valid();
+  }
+
   static void initGlobal(Graphics &graphics, GLFWwindow *window) {
     static Graphics &theguy = graphics;
     theguy.window = window;
     glfwGetWindowSize(window, &theguy.width, &theguy.height);
     glfwSetFramebufferSizeCallback(window, [](GLFWwindow *window, int w, int h) {
-      theguy.width = w;
-      theguy.height = h;
-      glViewport(0, 0, w, h);
+      theguy.resize(w, h);
     });
   }
 
+  /**
+   * Size of the framebuffer drawn into: the window's, or an offscreen target's.
+   */
+  void resize(int w, int h) {
+    width = w;
+    height = h;
+    glViewport(0, 0, w, h);
+  }
+
   void prepare() {
     glEnable(GL_DEPTH_TEST);
     glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
   }
 
-  void drawScene(double current_time, Scene &scene) {
-    glm::vec3 player_camera_pos = scene.player.pos + Scene::PERSON_HEAD;
+  /**
+   * `alpha` is how far `current_time` is between the previous and the latest simulation tick;
+   * moving objects are drawn interpolated between the two states.
+   */
+  void drawScene(double current_time, Scene &scene, float alpha = 1.0f) {
+    auto cpu_scope = profiler.cpu("drawScene");
+    gpu_timers.beginFrame();
+    assets.poll();
+
+    AngleTransform player = scene.interpolatedPlayer(alpha);
+    glm::vec3 player_camera_pos = player.pos + Scene::PERSON_HEAD;
     glm::mat4 view = glm::lookAt(player_camera_pos,
-                                 player_camera_pos + scene.player.getDir() * glm::vec3{0, 0, -1},
-                                 scene.player.getDir() * glm::vec3{0, 1, 0});
+                                 player_camera_pos + player.getDir() * glm::vec3{0, 0, -1},
+                                 player.getDir() * glm::vec3{0, 1, 0});
     glm::mat4 projection = glm::perspective<float>(glm::radians(60.),
                                                    (float)width / height,
                                                    0.01, 100);
 
-    // I don't care about performance
-
-    int number_of_lights = scene.projectiles.size();
-    auto lights_start = 0;
-    if (number_of_lights > MAX_NUM_OF_LIGHTS) {
-      lights_start += number_of_lights - MAX_NUM_OF_LIGHTS;
-      number_of_lights = MAX_NUM_OF_LIGHTS;
+    camera_pos_ = player_camera_pos;
+    lod_pixels_per_unit_ = projection[1][1] * height * 0.5f;
+    cullEntities(projection * view, current_time, scene, alpha);
+
+    // Instancing can be switched at runtime, compare the two paths
+    bool instanced = instancingActive();
+    size_t instance_count = (instanced
+        ? visible_.enemies.size() + visible_.projectiles.size() + visible_.dying.size()
+        : 0);
+    stream.beginFrame(sizeof(FrameData) + stream.uniformAlignment() + instance_count * sizeof(InstanceData) + 16);
+
+    // Mapped memory may be write-combined: only write to it
+    auto *frame = stream.allocate<FrameData>(1, stream.uniformAlignment());
+    frame->view = view;
+    frame->projection = projection;
+    frame->cluster_params = glm::vec4(width, height, LightClusters::FIRST_SLICE_DEPTH, LightClusters::LAST_SLICE_DEPTH);
+
+#ifndef __EMSCRIPTEN__
+    // Every projectile is a light, culled or not
+    light_positions_.clear();
+    for (size_t i = 0; i < scene.projectiles.size(); i++) {
+      glm::vec3 pos = interpolated_[scene.enemies.size() + i].pos;
+      light_positions_.emplace_back(glm::vec3(view * glm::vec4(pos, 1.0f)), LIGHT_RADIUS);
     }
+    light_clusters.build(light_positions_, projection, workers);
+    lights_texture.upload(light_positions_.data(), light_positions_.size() * sizeof(glm::vec4));
+    light_grid_texture.upload(light_clusters.grid().data(), light_clusters.grid().size() * sizeof(LightClusters::Range));
+    light_indices_texture.upload(light_clusters.indices().data(), light_clusters.indices().size() * sizeof(uint32_t));
+#endif
 
-    std::vector<glm::vec3> light_pos_array;
-    light_pos_array.reserve(number_of_lights);
-    for (int i = 0; i < number_of_lights; ++i) {
-      light_pos_array.push_back(scene.projectiles[lights_start + i].pos);
-    }
+    InstanceGroups groups;
+    if (instanced)
+      groups = writeInstances(stream.allocate<InstanceData>(instance_count), current_time, scene);
+
+    stream.flush();
+#ifndef __EMSCRIPTEN__
+    // The GLSL 100 shaders take the same matrices as the plain V and P uniforms set below
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, stream.buffer(), stream.offset(frame), sizeof(FrameData));
+#endif
 
-    glDepthMask(GL_FALSE);
-    glUseProgram(skybox_shader_program);
-    int v_matrix_sky_id = glGetUniformLocation(skybox_shader_program, "V");
-    int p_matrix_sky_id = glGetUniformLocation(skybox_shader_program, "P");
-    glUniformMatrix4fv(v_matrix_sky_id, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(p_matrix_sky_id, 1, GL_FALSE, glm::value_ptr(projection));
-    glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture);
-    skybox_mesh.draw();
-    glDepthMask(GL_TRUE);
+#ifndef __EMSCRIPTEN__
+    lights_texture.bind(LIGHTS_TEXTURE_UNIT);
+    light_grid_texture.bind(LIGHT_GRID_TEXTURE_UNIT);
+    light_indices_texture.bind(LIGHT_INDICES_TEXTURE_UNIT);
+#endif
+    glActiveTexture(GL_TEXTURE0);
 
     {
+      auto pass = gpu_timers.scope("skybox");
+      glDepthMask(GL_FALSE);
+      skybox_program.use();
+      glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture);
+      skybox_mesh.draw();
+      glDepthMask(GL_TRUE);
+    }
+
+    {
+      auto pass = gpu_timers.scope("ground");
       glm::mat4 ground_transform =
-          glm::translate(scene.player.pos + glm::vec3{0.0f, GROUND_Y_LEVEL, 0.0f}) *
+          glm::translate(player.pos + glm::vec3{0.0f, GROUND_Y_LEVEL, 0.0f}) *
           glm::scale(glm::vec3{
                 GROUND_RENDER_RADIUS,
                 GROUND_RENDER_RADIUS,
                 GROUND_RENDER_RADIUS
               });
 
-      glUseProgram(ground_shader_program);
-
-      int m_matrix_id = glGetUniformLocation(ground_shader_program, "M");
-      int v_matrix_id = glGetUniformLocation(ground_shader_program, "V");
-      int p_matrix_id = glGetUniformLocation(ground_shader_program, "P");
-      int light_pos_array_id = glGetUniformLocation(ground_shader_program, "light_pos_array");
-      int ambient_id = glGetUniformLocation(ground_shader_program, "ambientK");
-      int texture_id = glGetUniformLocation(ground_shader_program, "tex");
-      int number_of_lights_id = glGetUniformLocation(ground_shader_program, "number_of_lights");
-
-      glUniformMatrix4fv(v_matrix_id, 1, GL_FALSE, glm::value_ptr(view));
-      glUniformMatrix4fv(p_matrix_id,
-                         1,
-                         GL_FALSE,
-                         glm::value_ptr(projection));
-      glUniformMatrix4fv(m_matrix_id,
-                         1,
-                         GL_FALSE,
-                         glm::value_ptr(ground_transform));
-
-      if (number_of_lights > 0) {
-        glUniform3fv(light_pos_array_id,
-                     number_of_lights,
-                     glm::value_ptr(light_pos_array[0]));
-      }
+      ground_program.use();
+      ground_uniforms.model.set(ground_transform);
+      ground_uniforms.ambient.set(0.3f);
+      glBindTexture(GL_TEXTURE_2D, ground_texture);
+      ground_mesh.draw();
+    }
 
-      glUniform1f(ambient_id, 0.3f);
-      glUniform1i(number_of_lights_id, number_of_lights);
+    ModelUniforms &uniforms = (instanced ? instanced_uniforms : shader_uniforms);
+    (instanced ? instanced_shader_program : shader_program).use();
+    uniforms.view.set(view);
+    uniforms.projection.set(projection);
+    uniforms.ambient.set(0.3f);
+    draw_calls = 2; // skybox and ground
+    state_changes = 0;
+    triangles = triangles_without_lod = 0;
+
+    if (instanced)
+      drawInstances(groups);
+    else
+      drawEntities(current_time, scene, uniforms);
+
+    stream.endFrame();
+  }
 
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, ground_texture);
-      glUniform1i(texture_id, 0);
+ private:
+  /**
+   * Where each entity group starts in the instance stream, in instances; `end` is one past the last.
+   */
+  struct InstanceGroups {
+    size_t buffer_offset = 0;
+    // Intact entities are grouped by level of detail: level l is [enemies[l], enemies[l + 1])
+    size_t enemies[MAX_MESH_LODS + 1] = {}, projectiles[MAX_MESH_LODS + 1] = {};
+    size_t dying_enemies = 0, dying_projectiles = 0, end = 0;
+  };
+
+  /**
+   * Entities that passed culling this frame; transforms are interpolated.
+   */
+  struct VisibleEntities {
+    std::vector<QuatTransform> enemies, projectiles;
+    std::vector<uint8_t> enemy_lods, projectile_lods;
+    std::vector<uint32_t> dying; // indices in scene.dying_objects
+  };
+
+  /**
+   * Interpolates the moving entities and keeps those whose bounding spheres touch the view frustum.
+   */
+  void cullEntities(const glm::mat4 &view_projection, double current_time, Scene &scene, float alpha) {
+    size_t enemy_count = scene.enemies.size();
+    interpolated_.clear();
+    for (size_t i = 0; i < enemy_count; i++)
+      interpolated_.push_back(scene.enemies.interpolated(i, alpha));
+    for (size_t i = 0; i < scene.projectiles.size(); i++)
+      interpolated_.push_back(scene.projectiles.interpolated(i, alpha));
+
+    glm::vec4 enemy_sphere = enemySphere(), projectile_sphere = projectileSphere();
+    culler.begin(view_projection);
+    for (size_t i = 0; i < interpolated_.size(); i++) {
+      const QuatTransform &t = interpolated_[i];
+      glm::vec4 sphere = (i < enemy_count ? enemy_sphere : projectile_sphere);
+      culler.add(t.pos + t.dir * glm::vec3(sphere), sphere.w);
+    }
 
-      ground_mesh.draw();
+    const DyingObjects& dying = scene.dying_objects;
+    for (size_t i = 0; i < dying.size(); i++) {
+      glm::vec4 sphere = (dying.kind[i] == DyingObjects::Kind::projectile ? projectile_sphere : enemy_sphere);
+      // Pieces turn around their centroids and fly off at most |explosion_dir| + 10 per second (vertex.glsl)
+      float spread = (glm::length(dying.explosion_dir[i]) + 10) * explosionTime(dying, i, current_time);
+      culler.add(dying.pos[i] + dying.dir[i] * glm::vec3(sphere), 3 * sphere.w + spread);
     }
 
-    glUseProgram(shader_program);
+    visible_.enemies.clear();
+    visible_.projectiles.clear();
+    visible_.enemy_lods.clear();
+    visible_.projectile_lods.clear();
+    visible_.dying.clear();
+    for (uint32_t i : culler.cull(workers)) {
+      if (i < enemy_count) {
+        visible_.enemies.push_back(interpolated_[i]);
+        visible_.enemy_lods.push_back(updateLod(enemy_lods_, scene.enemies.handle(i).slot,
+                                                roma_mesh, 1.0f, interpolated_[i].pos));
+      } else if (i < interpolated_.size()) {
+        visible_.projectiles.push_back(interpolated_[i]);
+        visible_.projectile_lods.push_back(updateLod(projectile_lods_, scene.projectiles.handle(i - enemy_count).slot,
+                                                     projectile_mesh, PROJECTILE_SCALE, interpolated_[i].pos));
+      } else {
+        visible_.dying.push_back(i - (uint32_t)interpolated_.size());
+      }
+    }
+  }
 
-    int expl_time_id = glGetUniformLocation(shader_program, "explosionTime");
-    int expl_total_time_id = glGetUniformLocation(shader_program, "explosionTotalTime");
-    int expl_pos_id = glGetUniformLocation(shader_program, "explosionPos_world");
-    int expl_dir_id = glGetUniformLocation(shader_program, "explosionDir_world");
+  /**
+   * Picks the coarsest level whose error covers at most LOD_PIXEL_ERROR pixels. The level kept
+   * from the last frame (per entity slot) only changes once the error is LOD_HYSTERESIS past
+   * the threshold, so entities near a boundary distance do not flicker between levels.
+   */
+  uint8_t updateLod(std::vector<uint8_t> &slot_lods, uint32_t slot, const Mesh &mesh, float scale, const glm::vec3 &pos) {
+    if (slot >= slot_lods.size())
+      slot_lods.resize(slot + 1, 0);
+    if (!options.lod)
+      return slot_lods[slot] = 0;
+
+    float pixels_per_unit = lod_pixels_per_unit_ / std::max(glm::distance(pos, camera_pos_), 0.01f);
+    auto errorPixels = [&](uint32_t lod) { return mesh.lods[lod].error * scale * pixels_per_unit; };
+    uint32_t lod = std::min<uint32_t>(slot_lods[slot], mesh.lod_count - 1);
+    while (lod > 0 && errorPixels(lod) > LOD_PIXEL_ERROR * (1 + LOD_HYSTERESIS))
+      lod--;
+    while (lod + 1 < mesh.lod_count && errorPixels(lod + 1) < LOD_PIXEL_ERROR * (1 - LOD_HYSTERESIS))
+      lod++;
+    return slot_lods[slot] = (uint8_t)lod;
+  }
 
-    int m_matrix_id = glGetUniformLocation(shader_program, "M");
-    int v_matrix_id = glGetUniformLocation(shader_program, "V");
-    int p_matrix_id = glGetUniformLocation(shader_program, "P");
-    int light_pos_array_id = glGetUniformLocation(shader_program, "light_pos_array");
-    int ambient_id = glGetUniformLocation(shader_program, "ambientK");
-    int texture_id = glGetUniformLocation(shader_program, "tex");
-    int number_of_lights_id = glGetUniformLocation(shader_program, "number_of_lights");
+  void countTriangles(const Mesh &mesh, uint32_t lod, size_t instances) {
+    triangles += mesh.triangleCount(lod) * instances;
+    triangles_without_lod += mesh.triangleCount(0) * instances;
+  }
 
-    glUniformMatrix4fv(v_matrix_id, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(p_matrix_id, 1, GL_FALSE, glm::value_ptr(projection));
+  /**
+   * Per-entity draw, see entity_queue_.
+   */
+  struct EntityDraw {
+    glm::mat4 model;
+    float ambient;
+    float explosion_time;
+    glm::vec3 explosion_pos;
+    glm::vec3 explosion_dir;
+  };
+
+  // Sort key fields of the per-entity draws
+  enum DrawPass : uint32_t { ENEMIES_PASS, PROJECTILES_PASS, DYING_PASS, PASS_COUNT };
+  static constexpr const char *PASS_NAMES[PASS_COUNT] = {"enemies", "projectiles", "dying"};
+  enum DrawProgram : uint32_t { MODEL_PROGRAM, EXPLOSION_PROGRAM };
+  enum DrawModel : uint32_t { ENEMY_MODEL, PROJECTILE_MODEL }; // both mesh and texture
+
+  static constexpr size_t RECORD_BATCH = 1024;
+
+  /**
+   * Records the visible entities into entity_queue_, in parallel batches of RECORD_BATCH,
+   * each into its own bucket.
+   */
+  void recordEntities(double current_time, const Scene &scene) {
+    const DyingObjects& dying = scene.dying_objects;
+    uint32_t dying_program = (explosion_program.valid() ? EXPLOSION_PROGRAM : MODEL_PROGRAM);
+    size_t enemy_count = visible_.enemies.size(), projectile_count = visible_.projectiles.size();
+    size_t total = enemy_count + projectile_count + visible_.dying.size();
+    size_t batches = (total + RECORD_BATCH - 1) / RECORD_BATCH;
+
+    entity_queue_.reset(batches);
+    workers.parallelFor(batches, [&](size_t batch) {
+      auto &bucket = entity_queue_.bucket(batch);
+      for (size_t k = batch * RECORD_BATCH; k < std::min(total, (batch + 1) * RECORD_BATCH); k++) {
+        if (k < enemy_count) {
+          const QuatTransform &t = visible_.enemies[k];
+          bucket.push(sort_key::make(ENEMIES_PASS, MODEL_PROGRAM, ENEMY_MODEL, ENEMY_MODEL, visible_.enemy_lods[k], depth(t.pos)),
+                      EntityDraw{enemyModel(t), 0.3f, 0, {}, {}});
+        } else if (k < enemy_count + projectile_count) {
+          size_t j = k - enemy_count;
+          const QuatTransform &t = visible_.projectiles[j];
+          bucket.push(sort_key::make(PROJECTILES_PASS, MODEL_PROGRAM, PROJECTILE_MODEL, PROJECTILE_MODEL,
+                                     visible_.projectile_lods[j], depth(t.pos)),
+                      EntityDraw{projectileModel(t, current_time), 1.0f, 0, {}, {}});
+        } else {
+          uint32_t i = visible_.dying[k - enemy_count - projectile_count];
+          bool is_projectile = (dying.kind[i] == DyingObjects::Kind::projectile);
+          uint32_t model = (is_projectile ? PROJECTILE_MODEL : ENEMY_MODEL);
+          bucket.push(sort_key::make(DYING_PASS, dying_program, model, model, 0, depth(dying.pos[i])),
+                      EntityDraw{
+                          is_projectile ? projectileModel(dying.transform(i), current_time) : enemyModel(dying.transform(i)),
+                          is_projectile ? 1.0f : 0.1f,
+                          explosionTime(dying, i, current_time),
+                          dying.explosion_pos[i],
+                          dying.explosion_dir[i]});
+        }
+      }
+    });
+  }
 
-    if (number_of_lights > 0) {
-      glUniform3fv(light_pos_array_id,
-                   number_of_lights,
-                   glm::value_ptr(light_pos_array[0]));
-    }
+  [[nodiscard]] float depth(const glm::vec3 &pos) const {
+    glm::vec3 d = pos - camera_pos_;
+    return glm::dot(d, d);
+  }
 
-    glUniform1f(ambient_id, 0.3f);
-    glUniform1i(number_of_lights_id, number_of_lights);
+  /**
+   * The per-entity path: one draw call per entity, sorted so that programs, textures and
+   * uniforms are only set when they change.
+   */
+  void drawEntities(double current_time, Scene &scene, ModelUniforms &uniforms) {
+    recordEntities(current_time, scene);
+    entity_queue_.sort();
+
+    Mesh *meshes[] = {&roma_mesh, &projectile_mesh};
+    uint textures[] = {roma_texture, projectile_texture};
+    ModelUniforms *program_uniforms[] = {&uniforms, &explosion_uniforms};
+
+    std::optional<GpuTimers::Scope> pass;
+    uint32_t bound_pass = PASS_COUNT, bound_program = MODEL_PROGRAM, bound_texture = UINT32_MAX;
+    float bound_ambient = 0.3f; // drawScene set it
+    entity_queue_.submit([&](uint64_t key, const EntityDraw &draw) {
+      if (sort_key::pass(key) != bound_pass) {
+        bound_pass = sort_key::pass(key);
+        pass.reset();
+        pass.emplace(&gpu_timers, PASS_NAMES[bound_pass]);
+      }
+      ModelUniforms &u = *program_uniforms[sort_key::program(key)];
+      if (sort_key::program(key) != bound_program) {
+        bound_program = sort_key::program(key);
+        (bound_program == EXPLOSION_PROGRAM ? explosion_program : shader_program).use();
+        u.explosion_total_time.set((float)scene.dying_objects.death_duration);
+        bound_ambient = -1;
+        state_changes++;
+      }
+      if (sort_key::texture(key) != bound_texture) {
+        bound_texture = sort_key::texture(key);
+        glBindTexture(GL_TEXTURE_2D, textures[bound_texture]);
+        state_changes++;
+      }
+      if (draw.ambient != bound_ambient) {
+        bound_ambient = draw.ambient;
+        u.ambient.set(draw.ambient);
+      }
+      u.model.set(draw.model);
+
+      Mesh &mesh = *meshes[sort_key::mesh(key)];
+      uint32_t lod = sort_key::variant(key);
+      if (sort_key::pass(key) == DYING_PASS) {
+        u.explosion_pos.set(draw.explosion_pos);
+        u.explosion_dir.set(draw.explosion_dir);
+        u.explosion_time.set(draw.explosion_time);
+      }
+      if (bound_program == EXPLOSION_PROGRAM)
+        mesh.drawExploded();
+      else
+        mesh.draw(lod);
+      countTriangles(mesh, lod, 1);
+    });
+    draw_calls += (int)entity_queue_.size();
+  }
 
-    {
-      glm::vec3 dummy{1, 0, 0};
-      glUniform3fv(expl_pos_id, 1, glm::value_ptr(dummy));
-      glUniform3fv(expl_dir_id, 1, glm::value_ptr(dummy));
-      glUniform1f(expl_time_id, 0.0f);
-      glUniform1f(expl_total_time_id, 1.0f);
-    }
+  [[nodiscard]] VertexFormat modelFormat() const {
+    return options.compact_vertices ? VertexFormat::compact : VertexFormat::full;
+  }
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, roma_texture);
-    glUniform1i(texture_id, 0);
+  [[nodiscard]] std::string modelDefines() const {
+    return options.compact_vertices ? "#define OCT_NORMALS\n" : "";
+  }
 
-    for (auto& enemy_trans : scene.enemies) {
-      glm::mat4 model = enemy_trans.getMat()
-          * glm::translate(glm::vec3{0, -0.144, 0});
+  /**
+   * vertex.glsl with extra defines; GLSL 100 has no such variants, so the program is empty there.
+   */
+  [[nodiscard]] ShaderProgram modelVariant(const std::string &defines) const {
+    if (IS_EMSCRIPTEN)
+      return ShaderProgram();
+    return ShaderProgram("./shaders/vertex.glsl", "./shaders/fragment.glsl", "", modelDefines() + defines);
+  }
 
-      glUniformMatrix4fv(m_matrix_id, 1, GL_FALSE, glm::value_ptr(model));
-      roma_mesh.draw();
-    }
+  [[nodiscard]] glm::mat4 enemyModel(const QuatTransform &transform) const {
+    return transform.getMat() * glm::translate(ENEMY_OFFSET) * roma_mesh.position_transform;
+  }
 
-    glUniform1f(ambient_id, 1.0f);
-
-    glBindTexture(GL_TEXTURE_2D, projectile_texture);
-    for (auto& proj_trans : scene.projectiles) {
-      glm::mat4 model = (
-          proj_trans.getMat()
-          * glm::rotate(
-              (float)current_time * 10,
-              glm::vec3{0.1, 0, 1}
-              )
-          * glm::scale(glm::vec3{1., 1., 1.} / 5.0f)
-      );
-
-      glUniformMatrix4fv(m_matrix_id, 1, GL_FALSE, glm::value_ptr(model));
-      projectile_mesh.draw();
-    }
+  [[nodiscard]] glm::mat4 projectileModel(const QuatTransform &transform, double current_time) const {
+    return (
+        transform.getMat()
+        * glm::rotate(
+            (float)current_time * 10,
+            glm::vec3{0.1, 0, 1}
+            )
+        * glm::scale(glm::vec3(PROJECTILE_SCALE))
+        * projectile_mesh.position_transform
+    );
+  }
 
-    for (auto& obj : scene.dying_objects) {
-      glm::mat4 model;
-      if (obj.kind == DyingObject::Kind::projectile) {
-        model = (
-            obj.transform.getMat()
-            * glm::rotate(
-                // (float)obj.death_start * 10,
-                (float)current_time * 10,
-                glm::vec3{0.1, 0, 1}
-                )
-            * glm::scale(glm::vec3{1., 1., 1.} / 5.0f)
-        );
-      } else {
-        model = obj.transform.getMat() * glm::translate(glm::vec3{0, -0.144, 0});
+  /**
+   * Bounding spheres in the frame of the entity's QuatTransform: xyz - center, w - radius.
+   */
+  [[nodiscard]] glm::vec4 enemySphere() const {
+    return glm::vec4(ENEMY_OFFSET + roma_mesh.bounds.center, roma_mesh.bounds.radius);
+  }
+
+  [[nodiscard]] glm::vec4 projectileSphere() const {
+    // The mesh spins around the origin
+    const MeshBounds &bounds = projectile_mesh.bounds;
+    return glm::vec4(0, 0, 0, (glm::length(bounds.center) + bounds.radius) * PROJECTILE_SCALE);
+  }
+
+  static float explosionTime(const DyingObjects &dying, size_t i, double current_time) {
+    // The death may have happened during the tick we are still interpolating into
+    return (float)std::max(current_time - dying.death_start[i], 0.0);
+  }
+
+  /**
+   * Writes all entities to `out` grouped by mesh and explosion state, so that each group is one draw.
+   */
+  InstanceGroups writeInstances(InstanceData *out, double current_time, Scene &scene) {
+    const DyingObjects& dying = scene.dying_objects;
+    const glm::vec4 intact{0, 0, 0, 0};
+    const glm::vec4 intact_dir{1, 0, 0, 1};
+
+    InstanceGroups groups;
+    groups.buffer_offset = stream.offset(out);
+    size_t count = 0;
+
+    for (uint32_t lod = 0; lod < MAX_MESH_LODS; lod++) {
+      groups.enemies[lod] = count;
+      for (size_t k = 0; k < visible_.enemies.size(); k++) {
+        if (visible_.enemy_lods[k] == lod)
+          out[count++] = {enemyModel(visible_.enemies[k]), intact, intact_dir};
       }
-      glUniform3fv(expl_dir_id, 1, glm::value_ptr(obj.explosion_dir));
-      glUniform3fv(expl_pos_id, 1, glm::value_ptr(obj.explosion_pos));
-      glUniform1f(expl_time_id, (float)(current_time - obj.death_start));
-      glUniform1f(expl_total_time_id, (float)obj.death_duration);
-
-      glUniformMatrix4fv(m_matrix_id, 1, GL_FALSE, glm::value_ptr(model));
-      if (obj.kind == DyingObject::Kind::projectile) {
-        glUniform1f(ambient_id, 1.0f);
-        glBindTexture(GL_TEXTURE_2D, projectile_texture);
-        projectile_mesh.draw();
-      } else {
-        glUniform1f(ambient_id, 0.1f);
-        glBindTexture(GL_TEXTURE_2D, roma_texture);
-        roma_mesh.draw();
+    }
+    groups.enemies[MAX_MESH_LODS] = count;
+    for (uint32_t lod = 0; lod < MAX_MESH_LODS; lod++) {
+      groups.projectiles[lod] = count;
+      for (size_t k = 0; k < visible_.projectiles.size(); k++) {
+        if (visible_.projectile_lods[k] == lod)
+          out[count++] = {projectileModel(visible_.projectiles[k], current_time), intact, intact_dir};
+      }
+    }
+    groups.projectiles[MAX_MESH_LODS] = count;
+
+    auto addDying = [&](DyingObjects::Kind kind) {
+      for (uint32_t i : visible_.dying) {
+        if (dying.kind[i] != kind)
+          continue;
+        glm::mat4 model = (kind == DyingObjects::Kind::projectile
+            ? projectileModel(dying.transform(i), current_time)
+            : enemyModel(dying.transform(i)));
+        out[count++] = {
+            model,
+            glm::vec4(dying.explosion_pos[i], explosionTime(dying, i, current_time)),
+            glm::vec4(dying.explosion_dir[i], (float)dying.death_duration)
+        };
       }
+    };
+    groups.dying_enemies = count;
+    addDying(DyingObjects::Kind::enemy);
+    groups.dying_projectiles = count;
+    addDying(DyingObjects::Kind::projectile);
+    groups.end = count;
+    return groups;
+  }
+
+  void drawInstances(const InstanceGroups &groups) {
+    auto drawGroup = [&](Mesh &mesh, uint32_t lod, uint texture, float ambient, size_t start, size_t stop, bool exploding) {
+      if (start == stop)
+        return;
+      ModelUniforms &uniforms = (exploding ? instanced_explosion_uniforms : instanced_uniforms);
+      uniforms.ambient.set(ambient);
+      glBindTexture(GL_TEXTURE_2D, texture);
+      state_changes++;
+      size_t offset = groups.buffer_offset + start * sizeof(InstanceData);
+      if (exploding)
+        mesh.drawExplodedInstanced(stream.buffer(), offset, stop - start);
+      else
+        mesh.drawInstanced(stream.buffer(), offset, stop - start, lod);
+      countTriangles(mesh, lod, stop - start);
+      draw_calls++;
+    };
+    {
+      auto pass = gpu_timers.scope("enemies");
+      for (uint32_t lod = 0; lod < MAX_MESH_LODS; lod++)
+        drawGroup(roma_mesh, lod, roma_texture, 0.3f, groups.enemies[lod], groups.enemies[lod + 1], false);
+    }
+    {
+      auto pass = gpu_timers.scope("projectiles");
+      for (uint32_t lod = 0; lod < MAX_MESH_LODS; lod++)
+        drawGroup(projectile_mesh, lod, projectile_texture, 1.0f, groups.projectiles[lod], groups.projectiles[lod + 1], false);
     }
+
+    auto pass = gpu_timers.scope("dying");
+    instanced_explosion_program.use();
+    state_changes++;
+    drawGroup(roma_mesh, 0, roma_texture, 0.1f, groups.dying_enemies, groups.dying_projectiles, true);
+    drawGroup(projectile_mesh, 0, projectile_texture, 1.0f, groups.dying_projectiles, groups.end, true);
   }
 
- private:
-  static constexpr int MAX_NUM_OF_LIGHTS = 10;
+  RenderQueue<EntityDraw> entity_queue_;
+  std::vector<QuatTransform> interpolated_; // enemies, then projectiles
+  VisibleEntities visible_;
+  // Level of detail drawn last frame, by entity slot
+  std::vector<uint8_t> enemy_lods_, projectile_lods_;
+  glm::vec3 camera_pos_{0, 0, 0};
+  float lod_pixels_per_unit_ = 0; // at distance 1
+  std::vector<glm::vec4> light_positions_;
+
+  // 1/d^2 falloff is 1% at this distance; the shader fades lights to zero there
+  static constexpr float LIGHT_RADIUS = 10.0f;
+
+  static constexpr float LOD_PIXEL_ERROR = 1.0f;
+  static constexpr float LOD_HYSTERESIS = 0.25f;
+
+  static inline const glm::vec3 ENEMY_OFFSET{0, -0.144, 0};
+  static constexpr float PROJECTILE_SCALE = 1 / 5.0f;
 
   static constexpr float GROUND_RENDER_RADIUS = 100.0f;
   static constexpr float GROUND_Y_LEVEL = 0.0f;
@@ -0,0 +1,455 @@
+// Headless simulation driver: runs Scene::update under a scripted bot without
+// a window or GL context and reports throughput per update phase.
+//
+// usage: headless [--ticks N] [--dt SECONDS] [--spawn-delay SECONDS]
+//                 [--max-enemies N] [--fire-rate SHOTS_PER_SECOND] [--seed N]
+//                 [--kernels scalar|sse2|avx2] [--trace FILE] [--threads N[,N...]]
+//                 [--thread-sweep] [--replay FILE] [--check-kernels] [--check-sweep]
+//                 [--check-spawns]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "world.hpp"
+#include "bot.hpp"
+#include "replay.hpp"
+
+static const std::vector<unsigned> DEFAULT_THREAD_SWEEP = {1, 2, 4, 8, 16};
+
+struct HeadlessOptions {
+  long long ticks = 10000;
+  double dt = 1.0 / 60;
+  double fire_rate = 10;
+  int64_t seed = 42;
+  std::string kernels;
+  std::string trace; // Chrome trace output, also enables per-tick percentiles
+  std::vector<unsigned> threads; // thread counts to run with, including this thread; none: no pool
+  bool thread_sweep = false; // one run per thread count, DEFAULT_THREAD_SWEEP without --threads
+  std::string replay; // input recording from the game to run instead of the bot
+  bool check_kernels = false;
+  bool check_sweep = false;
+  bool check_spawns = false;
+  SceneConfig scene;
+};
+
+static HeadlessOptions parseOptions(int argc, char **argv) {
+  HeadlessOptions options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--check-kernels") {
+      options.check_kernels = true;
+      continue;
+    }
+    if (arg == "--check-sweep") {
+      options.check_sweep = true;
+      continue;
+    }
+    if (arg == "--check-spawns") {
+      options.check_spawns = true;
+      continue;
+    }
+    if (arg == "--thread-sweep") {
+      options.thread_sweep = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+      std::exit(1);
+    }
+    const char *value = argv[++i];
+    if (arg == "--ticks")
+      options.ticks = std::atoll(value);
+    else if (arg == "--dt")
+      options.dt = std::atof(value);
+    else if (arg == "--spawn-delay")
+      options.scene.spawn_delay = std::atof(value);
+    else if (arg == "--max-enemies")
+      options.scene.max_enemies = std::strtoull(value, nullptr, 10);
+    else if (arg == "--fire-rate")
+      options.fire_rate = std::atof(value);
+    else if (arg == "--seed")
+      options.seed = std::atoll(value);
+    else if (arg == "--kernels")
+      options.kernels = value;
+    else if (arg == "--trace")
+      options.trace = value;
+    else if (arg == "--replay")
+      options.replay = value;
+    else if (arg == "--threads") {
+      for (const char *p = value; *p;) {
+        char *next;
+        unsigned long count = std::strtoul(p, &next, 10);
+        if (next == p) {
+          std::fprintf(stderr, "bad thread counts %s\n", value);
+          std::exit(1);
+        }
+        options.threads.push_back((unsigned)std::max(1ul, count));
+        p = (*next == ',' ? next + 1 : next);
+      }
+    }
+    else {
+      std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+      std::exit(1);
+    }
+  }
+
+  if (options.threads.size() > 1)
+    options.thread_sweep = true;
+  if (options.thread_sweep && options.threads.empty())
+    options.threads = DEFAULT_THREAD_SWEEP;
+  if (options.thread_sweep && !options.replay.empty()) {
+    std::fprintf(stderr, "--replay runs with a single thread count, not a sweep\n");
+    std::exit(1);
+  }
+  return options;
+}
+
+/**
+ * Runs every batch kernel available on this CPU against the scalar reference
+ * on random data. Returns the number of mismatches.
+ */
+static int checkKernels() {
+  constexpr size_t COUNT = 1 << 16;
+  // Sums this close to the limit may legitimately differ if the compiler used FMA somewhere
+  constexpr float TOLERANCE = 1e-5f;
+
+  std::default_random_engine rng(1);
+  std::uniform_real_distribution<float> coord(-2.0f, 2.0f);
+  std::vector<float> xs(COUNT), ys(COUNT), zs(COUNT), deltas(COUNT * 3);
+  for (size_t i = 0; i < COUNT; i++) {
+    xs[i] = coord(rng);
+    ys[i] = coord(rng);
+    zs[i] = coord(rng);
+  }
+  for (float &d : deltas)
+    d = coord(rng);
+  std::vector<float> start(deltas.rbegin(), deltas.rend());
+
+  int failures = 0;
+  for (const SimdKernels *k : kernels::available()) {
+    int mismatches = 0;
+
+    // Segments of length zero are point tests, against the reference
+    std::vector<float> entries(COUNT);
+    for (int probe = 0; probe < 64; probe++) {
+      glm::vec3 p{coord(rng) * 0.5f, coord(rng) * 0.5f + 0.7f, coord(rng) * 0.5f};
+      // Odd offsets and lengths exercise the scalar tails
+      size_t offset = probe % 7;
+      size_t count = COUNT - offset - probe;
+      k->sweptEllipsoidHits(p, glm::vec3{0}, &xs[offset], &ys[offset], &zs[offset], count,
+                            Scene::PERSON_HEAD.y, 2.0f, entries.data());
+      for (size_t i = 0; i < count; i++) {
+        glm::vec3 e{xs[offset + i], ys[offset + i], zs[offset + i]};
+        bool expected = Scene::checkCollision(p, e);
+        if ((entries[i] == 0) != expected) {
+          float sum = glm::distance(p, e + Scene::PERSON_HEAD) + glm::distance(p, e);
+          if (std::abs(sum - 2.0f) > TOLERANCE)
+            mismatches++;
+        }
+      }
+    }
+
+    // Moving segments against the scalar version, and their entry points against the reference
+    std::vector<float> expected_entries(COUNT);
+    for (int probe = 0; probe < 64; probe++) {
+      glm::vec3 from{coord(rng) * 2, coord(rng) * 0.5f + 0.7f, coord(rng) * 2};
+      glm::vec3 delta{coord(rng) * 2, coord(rng) * 0.5f, coord(rng) * 2};
+      size_t offset = probe % 5;
+      size_t count = COUNT - offset - probe;
+      kernels::SCALAR.sweptEllipsoidHits(from, delta, &xs[offset], &ys[offset], &zs[offset], count,
+                                         Scene::PERSON_HEAD.y, 2.0f, expected_entries.data());
+      k->sweptEllipsoidHits(from, delta, &xs[offset], &ys[offset], &zs[offset], count,
+                            Scene::PERSON_HEAD.y, 2.0f, entries.data());
+      for (size_t i = 0; i < count; i++) {
+        if (std::abs(entries[i] - expected_entries[i]) > TOLERANCE)
+          mismatches++;
+        if (entries[i] > 0 && entries[i] <= 1) {
+          // The entry point is on the surface
+          glm::vec3 e{xs[offset + i], ys[offset + i], zs[offset + i]};
+          glm::vec3 p = from + delta * entries[i];
+          float sum = glm::distance(p, e + Scene::PERSON_HEAD) + glm::distance(p, e);
+          if (std::abs(sum - 2.0f) > 1e-3f)
+            mismatches++;
+        }
+      }
+    }
+
+    std::vector<float> expected = start, actual = start;
+    kernels::SCALAR.integrate(expected.data(), deltas.data(), expected.size() - 5, 0.016f);
+    k->integrate(actual.data(), deltas.data(), actual.size() - 5, 0.016f);
+    for (size_t i = 0; i < expected.size(); i++) {
+      if (std::abs(expected[i] - actual[i]) > TOLERANCE)
+        mismatches++;
+    }
+
+    // Spheres against a unit box; spheres touching a face within TOLERANCE may go either way
+    std::vector<float> radii(ys.begin(), ys.end());
+    for (float &r : radii)
+      r = std::abs(r) * 0.25f;
+    const glm::vec4 box[6] = {{1, 0, 0, 1}, {-1, 0, 0, 1}, {0, 1, 0, 1}, {0, -1, 0, 1}, {0, 0, 1, 1}, {0, 0, -1, 1}};
+    std::vector<uint8_t> visible(COUNT);
+    k->spheresInFrustum(box, &xs[3], &zs[3], &ys[3], &radii[3], COUNT - 3, visible.data());
+    for (size_t i = 0; i < COUNT - 3; i++) {
+      glm::vec3 c{xs[3 + i], zs[3 + i], ys[3 + i]};
+      float r = radii[3 + i];
+      // Outside iff beyond some face by more than r
+      float slack = std::max({std::abs(c.x), std::abs(c.y), std::abs(c.z)}) - 1.0f - r;
+      bool expected = (slack <= 0);
+      if (visible[i] != expected && std::abs(slack) > TOLERANCE)
+        mismatches++;
+    }
+
+    std::printf("%-8s %s (%d mismatches)\n", k->name, (mismatches ? "FAIL" : "ok"), mismatches);
+    failures += mismatches;
+  }
+  return failures;
+}
+
+/**
+ * Fires the same volley of fast projectiles into a field of enemies at several tick rates,
+ * down to one tick for the whole flight, and compares which enemies survive with the
+ * finest rate. Returns the number of tick rates that disagree.
+ */
+static int checkSweep() {
+  constexpr double DURATION = 4;
+  constexpr size_t ENEMIES = 400, PROJECTILES = 400;
+  constexpr float SPEED = 20; // 2 m per tick at 10 Hz, more than an enemy is wide
+
+  std::default_random_engine rng(3);
+  std::uniform_real_distribution<float> coord(-20.0f, 20.0f), angle(0.0f, glm::pi<float>() * 2), height(0.2f, 1.2f);
+  std::vector<glm::vec3> enemies(ENEMIES), starts(PROJECTILES), velocities(PROJECTILES);
+  for (glm::vec3 &e : enemies)
+    e = {coord(rng), 0, coord(rng)};
+  for (size_t i = 0; i < PROJECTILES; i++) {
+    float a = angle(rng);
+    starts[i] = {coord(rng) * 2, height(rng), coord(rng) * 2};
+    velocities[i] = glm::vec3{std::cos(a), 0, std::sin(a)} * SPEED;
+  }
+
+  auto survivors = [&](double tick_rate, int &killed) {
+    IdleInput input;
+    SceneConfig config;
+    config.max_enemies = 0;
+    Scene scene(&input, 1, config);
+    for (const glm::vec3 &e : enemies)
+      scene.enemies.add(QuatTransform{e, glm::quat(1, 0, 0, 0)});
+    for (size_t i = 0; i < PROJECTILES; i++)
+      scene.spawnProjectile(QuatTransform{starts[i], glm::quat(1, 0, 0, 0)}, velocities[i]);
+    long long ticks = std::llround(DURATION * tick_rate);
+    for (long long tick = 0; tick < ticks; tick++)
+      scene.update(1 / tick_rate);
+    killed = scene.killed_count;
+    std::vector<glm::vec3> result(scene.enemies.pos.begin(), scene.enemies.pos.end());
+    std::sort(result.begin(), result.end(), [](const glm::vec3 &a, const glm::vec3 &b) {
+      return a.x != b.x ? a.x < b.x : a.z < b.z;
+    });
+    return result;
+  };
+
+  int failures = 0;
+  std::vector<glm::vec3> reference;
+  std::printf("%10s %10s %16s %10s\n", "tick rate", "killed", "path per tick", "kill set");
+  for (double tick_rate : {240.0, 60.0, 20.0, 10.0, 2.0, 1 / DURATION}) {
+    int killed = 0;
+    std::vector<glm::vec3> result = survivors(tick_rate, killed);
+    if (reference.empty())
+      reference = result;
+    bool same = (result == reference);
+    failures += !same;
+    std::printf("%10.2f %10d %14.2f m %10s\n", tick_rate, killed, SPEED / tick_rate, (same ? "same" : "DIFFERS"));
+  }
+  return failures;
+}
+
+/**
+ * Spawns enemies into an idle scene at several spawn delays and tick rates and compares the
+ * count with the accumulator the scene used before the timer wheel: within one spawn after
+ * every tick, exactly at the end. Returns the number of cases that disagree.
+ */
+static int checkSpawns() {
+  constexpr long long TICKS = 6000;
+  struct Case {
+    double spawn_delay;
+    double tick_rate;
+  };
+  const Case CASES[] = {{2, 60}, {0.25, 60}, {1.0 / 60, 60}, {0.001, 60}, {0.25, 7}, {0.05, 144}};
+
+  std::printf("%10s %10s %10s %10s %10s\n", "delay s", "tick Hz", "spawned", "expected", "same");
+  int failures = 0;
+  for (const Case &c : CASES) {
+    IdleInput input;
+    SceneConfig config;
+    config.spawn_delay = c.spawn_delay;
+    config.max_enemies = (size_t)-1;
+    Scene scene(&input, 1, config);
+
+    double dt = 1 / c.tick_rate;
+    double since_last_spawn = c.spawn_delay;
+    size_t expected = 0;
+    bool same = true;
+    for (long long tick = 0; tick < TICKS; tick++) {
+      since_last_spawn += dt;
+      while (since_last_spawn >= c.spawn_delay) {
+        since_last_spawn -= c.spawn_delay;
+        expected++;
+      }
+      scene.update(dt);
+      // A deadline landing exactly on a tick may round to either side of it
+      size_t spawned = scene.enemies.size() + scene.killed_count;
+      same = same && spawned + 1 >= expected && spawned <= expected + 1;
+    }
+    same = same && (scene.enemies.size() + scene.killed_count == expected);
+    failures += !same;
+    std::printf("%10.4f %10.1f %10zu %10zu %10s\n", c.spawn_delay, c.tick_rate,
+                scene.enemies.size() + scene.killed_count, expected, (same ? "ok" : "FAIL"));
+  }
+  return failures;
+}
+
+struct RunResult {
+  double wall_seconds = 0;
+  double game_time = 0;
+  double entity_ticks = 0;
+  size_t peak_entities = 0;
+  // Summary of the final state, equal between runs that made the same decisions
+  uint64_t state_hash = 0;
+};
+
+static RunResult run(const HeadlessOptions &options, Scene &scene, ScriptedBot &bot, Profiler &profiler) {
+  RunResult result;
+  auto start = std::chrono::steady_clock::now();
+  for (long long tick = 0; tick < options.ticks; tick++) {
+    int shots = bot.advance(options.dt);
+    for (int i = 0; i < shots; i++)
+      scene.spawnProjectile();
+
+    result.game_time += options.dt;
+    scene.update(options.dt);
+    profiler.endFrame();
+
+    size_t entities = scene.enemies.size() + scene.projectiles.size() + scene.dying_objects.size();
+    result.entity_ticks += entities;
+    result.peak_entities = std::max(result.peak_entities, entities);
+  }
+  result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  result.state_hash = scene.stateHash();
+  return result;
+}
+
+/**
+ * Runs the same simulation once per thread count and reports the speedup over the first;
+ * the final states must be identical. Returns the number of runs that diverged.
+ */
+static int threadSweep(const HeadlessOptions &options) {
+  std::printf("%8s %12s %12s %10s %10s\n", "threads", "wall s", "ticks/sec", "speedup", "state");
+  double base_seconds = 0;
+  uint64_t base_hash = 0;
+  int diverged = 0;
+  for (size_t i = 0; i < options.threads.size(); i++) {
+    ThreadPool pool(options.threads[i] - 1);
+    ScriptedBot bot(options.fire_rate);
+    Scene scene(&bot, options.seed, options.scene);
+    scene.pool = &pool;
+    Profiler profiler;
+    RunResult result = run(options, scene, bot, profiler);
+    if (i == 0) {
+      base_seconds = result.wall_seconds;
+      base_hash = result.state_hash;
+    }
+    bool same = (result.state_hash == base_hash);
+    diverged += !same;
+    std::printf("%8u %12.3f %12.1f %10.2f %10s\n", options.threads[i], result.wall_seconds,
+                options.ticks / result.wall_seconds, base_seconds / result.wall_seconds, (same ? "same" : "DIFFERS"));
+  }
+  return diverged;
+}
+
+/**
+ * Runs a recording from the game as fast as possible and checks its state hashes.
+ */
+static int replayRecording(const HeadlessOptions &options) {
+  replay::Player player(options.replay);
+  if (!player.valid()) {
+    std::fprintf(stderr, "cannot read recording %s\n", options.replay.c_str());
+    return 1;
+  }
+  std::optional<ThreadPool> pool;
+  if (!options.threads.empty()) {
+    pool.emplace(options.threads[0] - 1);
+    player.scene().pool = &*pool;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  while (player.step()) {
+  }
+  replay::printReport(player, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  return player.mismatches() == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  HeadlessOptions options = parseOptions(argc, argv);
+
+  if (options.check_kernels)
+    return checkKernels() == 0 ? 0 : 1;
+  if (options.check_sweep)
+    return checkSweep() == 0 ? 0 : 1;
+  if (options.check_spawns)
+    return checkSpawns() == 0 ? 0 : 1;
+
+  kernels::active() = kernels::select(options.kernels);
+  std::printf("kernels:        %s\n", simdKernels().name);
+
+  if (options.thread_sweep)
+    return threadSweep(options) == 0 ? 0 : 1;
+
+  if (!options.replay.empty())
+    return replayRecording(options);
+
+  std::optional<ThreadPool> pool;
+  ScriptedBot bot(options.fire_rate);
+  Scene scene(&bot, options.seed, options.scene);
+  scene.measure_phases = true;
+  if (!options.threads.empty()) {
+    pool.emplace(options.threads[0] - 1);
+    scene.pool = &*pool;
+  }
+  Profiler profiler;
+  if (!options.trace.empty())
+    scene.profiler = &profiler;
+
+  RunResult result = run(options, scene, bot, profiler);
+  double entity_ticks = result.entity_ticks;
+
+  std::printf("ticks:          %lld (%.1f s simulated)\n", options.ticks, result.game_time);
+  std::printf("wall time:      %.3f s\n", result.wall_seconds);
+  std::printf("ticks/sec:      %.1f\n", options.ticks / result.wall_seconds);
+  std::printf("killed:         %d\n", scene.killed_count);
+  std::printf("peak entities:  %zu\n", result.peak_entities);
+  std::printf("final:          %zu enemies, %zu projectiles, %zu dying\n",
+              scene.enemies.size(), scene.projectiles.size(), scene.dying_objects.size());
+
+  std::printf("\n%-18s %12s %14s\n", "phase", "total ms", "ns/entity");
+  for (size_t phase = 0; phase < (size_t)Scene::Phase::count; phase++) {
+    double seconds = scene.phase_seconds[phase];
+    std::printf("%-18s %12.3f %14.2f\n", Scene::PHASE_NAMES[phase], seconds * 1e3,
+                (entity_ticks > 0 ? seconds * 1e9 / entity_ticks : 0.0));
+  }
+
+  if (!options.trace.empty()) {
+    std::printf("\n%-18s %12s %12s  (last %zu ticks)\n", "phase", "p50 us", "p99 us", Profiler::HISTORY);
+    for (const Profiler::Scope &phase : profiler.scopes())
+      std::printf("%-18s %12.2f %12.2f\n", phase.name, phase.percentile(0.5f) * 1e3, phase.percentile(0.99f) * 1e3);
+    if (!profiler.writeChromeTrace(options.trace)) {
+      std::fprintf(stderr, "cannot write %s\n", options.trace.c_str());
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -4,6 +4,8 @@
 #include <glm/glm.hpp>
 #include <optional>
 
+#include "controls.hpp"
+
 using namespace glm;
 
 /**
@@ -46,7 +48,21 @@ private:
   }
 };
 
-struct InputContext {
+struct InputContext : InputSource {
+    explicit InputContext(GLFWwindow *window_) : window(window_) {
+    }
+
     GLFWwindow *window;
     MouseInput mouse_input;
+
+    PlayerControls poll() override {
+      PlayerControls controls;
+      controls.right = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+      controls.left = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+      controls.forward = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+      controls.backward = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+      controls.slow = glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS;
+      controls.cursor = mouse_input.getPos();
+      return controls;
+    }
 };
\ No newline at end of file
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Batch kernels for the hot simulation loops.
+ *
+ * Every kernel has a portable scalar version and x86 SSE2/AVX2 versions; the
+ * best one the CPU supports is picked on first use. All versions do the same
+ * float operations in the same order, so unless the compiler contracts them
+ * into FMAs their results match bit for bit.
+ */
+struct SimdKernels {
+  const char *name;
+
+  /**
+   * values[i] += deltas[i] * scale for i < count. Used on flattened vec3 arrays.
+   */
+  void (*integrate)(float *values, const float *deltas, size_t count, float scale);
+
+  /**
+   * Swept two-focus ellipsoid test of the segment from `from` to `from + delta` against
+   * `count` enemies given by their feet coordinates; the second focus is `head` above the
+   * feet, and points with distance sum < max_distance_sum are inside. Sets entry[i] to the
+   * segment parameter in [0, 1] where the segment is first inside, or to NO_ENTRY.
+   * The ellipsoid is a spheroid, so this is a segment-sphere test in scaled coordinates.
+   */
+  void (*sweptEllipsoidHits)(const glm::vec3 &from, const glm::vec3 &delta,
+                             const float *xs, const float *ys, const float *zs, size_t count,
+                             float head, float max_distance_sum, float *entry);
+
+  /**
+   * Tests `count` spheres against 6 planes (xyz - unit normal pointing inside, w - offset).
+   * Sets visible[i] to 0 if the sphere lies entirely behind some plane, to 1 otherwise.
+   */
+  void (*spheresInFrustum)(const glm::vec4 *planes,
+                           const float *xs, const float *ys, const float *zs, const float *radii, size_t count,
+                           uint8_t *visible);
+};
+
+namespace kernels {
+
+constexpr float NO_ENTRY = 2;
+
+/**
+ * Per-call constants of sweptEllipsoidHits: with p relative to the center and scaled by
+ * 1/semi-axes, the segment is inside where |p + t*d|^2 < 1, i.e. at^2 + 2bt + c < 0.
+ */
+struct SweptEllipsoid {
+  float half_head;
+  float inv_a2; // 1 / semi-major axis^2 (vertical)
+  float inv_b2; // 1 / semi-minor axis^2
+  float a;      // |d|^2 in scaled coordinates
+
+  SweptEllipsoid(const glm::vec3 &delta, float head, float max_distance_sum) {
+    half_head = head * 0.5f;
+    float semi_major = max_distance_sum * 0.5f;
+    inv_a2 = 1 / (semi_major * semi_major);
+    inv_b2 = 1 / (semi_major * semi_major - half_head * half_head);
+    a = (delta.x * delta.x + delta.z * delta.z) * inv_b2 + delta.y * delta.y * inv_a2;
+  }
+};
+
+inline void integrateScalar(float *values, const float *deltas, size_t count, float scale) {
+  for (size_t i = 0; i < count; i++)
+    values[i] += deltas[i] * scale;
+}
+
+inline void sweptEllipsoidHitsScalar(const glm::vec3 &from, const glm::vec3 &delta,
+                                     const float *xs, const float *ys, const float *zs, size_t count,
+                                     float head, float max_distance_sum, float *entry) {
+  SweptEllipsoid e(delta, head, max_distance_sum);
+  for (size_t i = 0; i < count; i++) {
+    float cx = from.x - xs[i];
+    float cy = from.y - (ys[i] + e.half_head);
+    float cz = from.z - zs[i];
+    float b = (cx * delta.x + cz * delta.z) * e.inv_b2 + cy * delta.y * e.inv_a2;
+    float c = (cx * cx + cz * cz) * e.inv_b2 + cy * cy * e.inv_a2 - 1;
+    float disc = b * b - e.a * c;
+    float t = NO_ENTRY;
+    if (c < 0) {
+      t = 0; // starts inside
+    } else if (b < 0 && disc > 0) {
+      // Nearer root, before the end if it is not past a, i.e. t <= 1
+      float near = -b - std::sqrt(disc);
+      if (near <= e.a)
+        t = near / e.a;
+    }
+    entry[i] = t;
+  }
+}
+
+inline void spheresInFrustumScalar(const glm::vec4 *planes,
+                                   const float *xs, const float *ys, const float *zs, const float *radii, size_t count,
+                                   uint8_t *visible) {
+  for (size_t i = 0; i < count; i++) {
+    bool inside = true;
+    for (int p = 0; p < 6; p++) {
+      float distance = planes[p].x * xs[i] + planes[p].y * ys[i] + planes[p].z * zs[i] + planes[p].w;
+      inside = inside && (distance >= -radii[i]);
+    }
+    visible[i] = inside;
+  }
+}
+
+#ifdef KERNELS_X86
+
+inline void integrateSse2(float *values, const float *deltas, size_t count, float scale) {
+  __m128 s = _mm_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 v = _mm_loadu_ps(values + i);
+    __m128 d = _mm_loadu_ps(deltas + i);
+    _mm_storeu_ps(values + i, _mm_add_ps(v, _mm_mul_ps(d, s)));
+  }
+  integrateScalar(values + i, deltas + i, count - i, scale);
+}
+
+inline void sweptEllipsoidHitsSse2(const glm::vec3 &from, const glm::vec3 &delta,
+                                   const float *xs, const float *ys, const float *zs, size_t count,
+                                   float head, float max_distance_sum, float *entry) {
+  SweptEllipsoid e(delta, head, max_distance_sum);
+  __m128 fx = _mm_set1_ps(from.x), fy = _mm_set1_ps(from.y), fz = _mm_set1_ps(from.z);
+  __m128 dx = _mm_set1_ps(delta.x), dy = _mm_set1_ps(delta.y), dz = _mm_set1_ps(delta.z);
+  __m128 half_head = _mm_set1_ps(e.half_head), inv_a2 = _mm_set1_ps(e.inv_a2), inv_b2 = _mm_set1_ps(e.inv_b2);
+  __m128 a = _mm_set1_ps(e.a), zero = _mm_setzero_ps(), one = _mm_set1_ps(1), no_entry = _mm_set1_ps(NO_ENTRY);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 cx = _mm_sub_ps(fx, _mm_loadu_ps(xs + i));
+    __m128 cy = _mm_sub_ps(fy, _mm_add_ps(_mm_loadu_ps(ys + i), half_head));
+    __m128 cz = _mm_sub_ps(fz, _mm_loadu_ps(zs + i));
+    __m128 b = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(cx, dx), _mm_mul_ps(cz, dz)), inv_b2),
+                          _mm_mul_ps(_mm_mul_ps(cy, dy), inv_a2));
+    __m128 c = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cz, cz)), inv_b2),
+                                     _mm_mul_ps(_mm_mul_ps(cy, cy), inv_a2)), one);
+    __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+    __m128 near = _mm_sub_ps(_mm_sub_ps(zero, b), _mm_sqrt_ps(_mm_max_ps(disc, zero)));
+    __m128 crosses = _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(b, zero), _mm_cmpgt_ps(disc, zero)), _mm_cmple_ps(near, a));
+    __m128 t = _mm_or_ps(_mm_and_ps(crosses, _mm_div_ps(near, a)), _mm_andnot_ps(crosses, no_entry));
+    _mm_storeu_ps(entry + i, _mm_andnot_ps(_mm_cmplt_ps(c, zero), t)); // inside: +0
+  }
+  sweptEllipsoidHitsScalar(from, delta, xs + i, ys + i, zs + i, count - i, head, max_distance_sum, entry + i);
+}
+
+inline void spheresInFrustumSse2(const glm::vec4 *planes,
+                                 const float *xs, const float *ys, const float *zs, const float *radii, size_t count,
+                                 uint8_t *visible) {
+  __m128 zero = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(xs + i), y = _mm_loadu_ps(ys + i), z = _mm_loadu_ps(zs + i);
+    __m128 neg_r = _mm_sub_ps(zero, _mm_loadu_ps(radii + i));
+    __m128 inside = _mm_cmpeq_ps(zero, zero);
+    for (int p = 0; p < 6; p++) {
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+          _mm_mul_ps(_mm_set1_ps(planes[p].x), x),
+          _mm_mul_ps(_mm_set1_ps(planes[p].y), y)),
+          _mm_mul_ps(_mm_set1_ps(planes[p].z), z)),
+          _mm_set1_ps(planes[p].w));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, neg_r));
+    }
+    int mask = _mm_movemask_ps(inside);
+    for (int k = 0; k < 4; k++)
+      visible[i + k] = (mask >> k) & 1;
+  }
+  spheresInFrustumScalar(planes, xs + i, ys + i, zs + i, radii + i, count - i, visible + i);
+}
+
+__attribute__((target("avx2")))
+inline void integrateAvx2(float *values, const float *deltas, size_t count, float scale) {
+  __m256 s = _mm256_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256 v0 = _mm256_loadu_ps(values + i), v1 = _mm256_loadu_ps(values + i + 8);
+    __m256 d0 = _mm256_loadu_ps(deltas + i), d1 = _mm256_loadu_ps(deltas + i + 8);
+    _mm256_storeu_ps(values + i, _mm256_add_ps(v0, _mm256_mul_ps(d0, s)));
+    _mm256_storeu_ps(values + i + 8, _mm256_add_ps(v1, _mm256_mul_ps(d1, s)));
+  }
+  for (; i + 8 <= count; i += 8) {
+    __m256 v = _mm256_loadu_ps(values + i);
+    __m256 d = _mm256_loadu_ps(deltas + i);
+    _mm256_storeu_ps(values + i, _mm256_add_ps(v, _mm256_mul_ps(d, s)));
+  }
+  integrateScalar(values + i, deltas + i, count - i, scale);
+}
+
+__attribute__((target("avx2")))
+inline void sweptEllipsoidHitsAvx2(const glm::vec3 &from, const glm::vec3 &delta,
+                                   const float *xs, const float *ys, const float *zs, size_t count,
+                                   float head, float max_distance_sum, float *entry) {
+  SweptEllipsoid e(delta, head, max_distance_sum);
+  __m256 fx = _mm256_set1_ps(from.x), fy = _mm256_set1_ps(from.y), fz = _mm256_set1_ps(from.z);
+  __m256 dx = _mm256_set1_ps(delta.x), dy = _mm256_set1_ps(delta.y), dz = _mm256_set1_ps(delta.z);
+  __m256 half_head = _mm256_set1_ps(e.half_head), inv_a2 = _mm256_set1_ps(e.inv_a2), inv_b2 = _mm256_set1_ps(e.inv_b2);
+  __m256 a = _mm256_set1_ps(e.a), zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1), no_entry = _mm256_set1_ps(NO_ENTRY);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 cx = _mm256_sub_ps(fx, _mm256_loadu_ps(xs + i));
+    __m256 cy = _mm256_sub_ps(fy, _mm256_add_ps(_mm256_loadu_ps(ys + i), half_head));
+    __m256 cz = _mm256_sub_ps(fz, _mm256_loadu_ps(zs + i));
+    __m256 b = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(cx, dx), _mm256_mul_ps(cz, dz)), inv_b2),
+                             _mm256_mul_ps(_mm256_mul_ps(cy, dy), inv_a2));
+    __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cz, cz)), inv_b2),
+                                           _mm256_mul_ps(_mm256_mul_ps(cy, cy), inv_a2)), one);
+    __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+    __m256 near = _mm256_sub_ps(_mm256_sub_ps(zero, b), _mm256_sqrt_ps(_mm256_max_ps(disc, zero)));
+    __m256 crosses = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(b, zero, _CMP_LT_OQ), _mm256_cmp_ps(disc, zero, _CMP_GT_OQ)),
+                                   _mm256_cmp_ps(near, a, _CMP_LE_OQ));
+    __m256 t = _mm256_blendv_ps(no_entry, _mm256_div_ps(near, a), crosses);
+    _mm256_storeu_ps(entry + i, _mm256_andnot_ps(_mm256_cmp_ps(c, zero, _CMP_LT_OQ), t)); // inside: +0
+  }
+  sweptEllipsoidHitsSse2(from, delta, xs + i, ys + i, zs + i, count - i, head, max_distance_sum, entry + i);
+}
+
+__attribute__((target("avx2")))
+inline void spheresInFrustumAvx2(const glm::vec4 *planes,
+                                 const float *xs, const float *ys, const float *zs, const float *radii, size_t count,
+                                 uint8_t *visible) {
+  __m256 zero = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 x = _mm256_loadu_ps(xs + i), y = _mm256_loadu_ps(ys + i), z = _mm256_loadu_ps(zs + i);
+    __m256 neg_r = _mm256_sub_ps(zero, _mm256_loadu_ps(radii + i));
+    __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+    for (int p = 0; p < 6; p++) {
+      __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+          _mm256_mul_ps(_mm256_set1_ps(planes[p].x), x),
+          _mm256_mul_ps(_mm256_set1_ps(planes[p].y), y)),
+          _mm256_mul_ps(_mm256_set1_ps(planes[p].z), z)),
+          _mm256_set1_ps(planes[p].w));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, neg_r, _CMP_GE_OQ));
+    }
+    int mask = _mm256_movemask_ps(inside);
+    for (int k = 0; k < 8; k++)
+      visible[i + k] = (mask >> k) & 1;
+  }
+  spheresInFrustumSse2(planes, xs + i, ys + i, zs + i, radii + i, count - i, visible + i);
+}
+
+#endif
+
+constexpr SimdKernels SCALAR{"scalar", integrateScalar, sweptEllipsoidHitsScalar, spheresInFrustumScalar};
+#ifdef KERNELS_X86
+constexpr SimdKernels SSE2{"sse2", integrateSse2, sweptEllipsoidHitsSse2, spheresInFrustumSse2};
+constexpr SimdKernels AVX2{"avx2", integrateAvx2, sweptEllipsoidHitsAvx2, spheresInFrustumAvx2};
+#endif
+
+/**
+ * Kernel sets usable on this CPU, best last.
+ */
+inline std::vector<const SimdKernels *> available() {
+  std::vector<const SimdKernels *> result{&SCALAR};
+#ifdef KERNELS_X86
+  result.push_back(&SSE2);
+  if (__builtin_cpu_supports("avx2"))
+    result.push_back(&AVX2);
+#endif
+  return result;
+}
+
+/**
+ * Picks the best kernel set, or the one called `name` if it is available.
+ */
+inline const SimdKernels *select(const std::string &name = "") {
+  auto candidates = available();
+  for (const SimdKernels *k : candidates) {
+    if (name == k->name)
+      return k;
+  }
+  return candidates.back();
+}
+
+inline const SimdKernels *&active() {
+  static const SimdKernels *kernels = select();
+  return kernels;
+}
+
+} // namespace kernels
+
+inline const SimdKernels &simdKernels() {
+  return *kernels::active();
+}
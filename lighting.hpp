@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "thread_pool.hpp"
+
+/**
+ * Clustered light binning for forward shading.
+ *
+ * The view frustum is cut into CLUSTERS_X x CLUSTERS_Y screen tiles and CLUSTERS_Z depth
+ * slices spaced exponentially between FIRST_SLICE_DEPTH and LAST_SLICE_DEPTH (anything
+ * nearer falls into the first slice). Every point light is a sphere; build() lists, for each
+ * cluster, the lights whose sphere touches the cluster's camera space bounding box, so a
+ * fragment only loops over the lights of its own cluster. The constants must match
+ * shaders/frame.glsl.
+ */
+class LightClusters {
+ public:
+  static constexpr int CLUSTERS_X = 16;
+  static constexpr int CLUSTERS_Y = 9;
+  static constexpr int CLUSTERS_Z = 24;
+  static constexpr int CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+  static constexpr float FIRST_SLICE_DEPTH = 0.1f;
+  static constexpr float LAST_SLICE_DEPTH = 100.0f;
+
+  /**
+   * Per cluster: first entry in indices() and number of lights.
+   */
+  struct Range {
+    uint32_t offset;
+    uint32_t count;
+  };
+
+  /**
+   * `lights` are camera space positions (xyz) and radii (w); `projection` is a symmetric perspective.
+   */
+  void build(const std::vector<glm::vec4> &lights, const glm::mat4 &projection, ThreadPool &pool) {
+    updateBounds(projection);
+
+    slice_indices_.resize(CLUSTERS_Z);
+    slice_lights_.resize(CLUSTERS_Z);
+    grid_.resize(CLUSTER_COUNT);
+
+    pool.parallelFor(CLUSTERS_Z, [&](size_t z) {
+      float near = sliceDepth((int)z), far = sliceDepth((int)z + 1);
+      if (z == 0)
+        near = 0;
+
+      std::vector<uint32_t> &candidates = slice_lights_[z];
+      candidates.clear();
+      for (uint32_t i = 0; i < lights.size(); i++) {
+        float depth = -lights[i].z;
+        if (depth + lights[i].w >= near && depth - lights[i].w <= far)
+          candidates.push_back(i);
+      }
+
+      // Clusters of one slice are contiguous in the grid, so their lists are contiguous too
+      std::vector<uint32_t> &indices = slice_indices_[z];
+      indices.clear();
+      for (int tile = 0; tile < CLUSTERS_X * CLUSTERS_Y; tile++) {
+        size_t cluster = z * CLUSTERS_X * CLUSTERS_Y + tile;
+        const Box &box = bounds_[cluster];
+        uint32_t first = (uint32_t)indices.size();
+        for (uint32_t i : candidates) {
+          glm::vec3 center{lights[i]};
+          glm::vec3 d = center - glm::clamp(center, box.min, box.max);
+          if (glm::dot(d, d) <= lights[i].w * lights[i].w)
+            indices.push_back(i);
+        }
+        grid_[cluster] = Range{first, (uint32_t)indices.size() - first};
+      }
+    });
+
+    // Rebase the per slice lists into one array, in slice order
+    indices_.clear();
+    for (int z = 0; z < CLUSTERS_Z; z++) {
+      uint32_t base = (uint32_t)indices_.size();
+      for (int tile = 0; tile < CLUSTERS_X * CLUSTERS_Y; tile++)
+        grid_[z * CLUSTERS_X * CLUSTERS_Y + tile].offset += base;
+      indices_.insert(indices_.end(), slice_indices_[z].begin(), slice_indices_[z].end());
+    }
+  }
+
+  [[nodiscard]] const std::vector<Range> &grid() const {
+    return grid_;
+  }
+
+  [[nodiscard]] const std::vector<uint32_t> &indices() const {
+    return indices_;
+  }
+
+  static float sliceDepth(int slice) {
+    return FIRST_SLICE_DEPTH * std::pow(LAST_SLICE_DEPTH / FIRST_SLICE_DEPTH, (float)slice / CLUSTERS_Z);
+  }
+
+ private:
+  struct Box {
+    glm::vec3 min, max;
+  };
+
+  std::vector<Box> bounds_;
+  float bounds_x_scale_ = 0, bounds_y_scale_ = 0;
+
+  std::vector<Range> grid_;
+  std::vector<uint32_t> indices_;
+  std::vector<std::vector<uint32_t>> slice_lights_, slice_indices_;
+
+  /**
+   * Camera space boxes around each cluster; only change with the projection.
+   */
+  void updateBounds(const glm::mat4 &projection) {
+    // For a symmetric perspective, camera space x = ndc_x * depth / projection[0][0]
+    float x_scale = 1.0f / projection[0][0], y_scale = 1.0f / projection[1][1];
+    if (!bounds_.empty() && x_scale == bounds_x_scale_ && y_scale == bounds_y_scale_)
+      return;
+    bounds_x_scale_ = x_scale;
+    bounds_y_scale_ = y_scale;
+
+    bounds_.resize(CLUSTER_COUNT);
+    for (int z = 0; z < CLUSTERS_Z; z++) {
+      float near = (z == 0 ? 0.0f : sliceDepth(z)), far = sliceDepth(z + 1);
+      if (z == CLUSTERS_Z - 1)
+        far = LAST_SLICE_DEPTH * 2; // everything beyond the last slice is clamped into it
+      for (int y = 0; y < CLUSTERS_Y; y++) {
+        for (int x = 0; x < CLUSTERS_X; x++) {
+          float ndc_x[2] = {-1 + 2.0f * x / CLUSTERS_X, -1 + 2.0f * (x + 1) / CLUSTERS_X};
+          float ndc_y[2] = {-1 + 2.0f * y / CLUSTERS_Y, -1 + 2.0f * (y + 1) / CLUSTERS_Y};
+          Box box{glm::vec3(INFINITY), glm::vec3(-INFINITY)};
+          for (float depth : {near, far}) {
+            for (float nx : ndc_x) {
+              for (float ny : ndc_y) {
+                glm::vec3 corner{nx * depth * x_scale, ny * depth * y_scale, -depth};
+                box.min = glm::min(box.min, corner);
+                box.max = glm::max(box.max, corner);
+              }
+            }
+          }
+          bounds_[(z * CLUSTERS_Y + y) * CLUSTERS_X + x] = box;
+        }
+      }
+    }
+  }
+};
@@ -48,94 +48,138 @@ void dumpGLErrors(std::string location="") {
 #include "input.hpp"
 #include "graphics.hpp"
 #include "ui.hpp"
-
-GLFWwindow* initGlewGLFW() {
-  // Initialise GLFW
-  if( !glfwInit() )
-  {
-    fprintf( stderr, "Failed to initialize GLFW\n" );
-    getchar();
-    exit(1);
-  }
-
-  glfwWindowHint(GLFW_SAMPLES, 4);
-
-#ifndef __EMSCRIPTEN__
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  #ifdef __APPLE__
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
-  #endif
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
-#else
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
-  glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
-#endif
-
-  GLFWwindow *window = glfwCreateWindow( 1024, 768, "Sample window", nullptr, nullptr);
-  if (window == nullptr) {
-    const char* description = nullptr;
-    #ifndef __EMSCRIPTEN__
-    glfwGetError(&description);
-    #else
-    description = "(no description available)";
-    #endif
-    std::cerr << description << "\n"
-              << "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials." << std::endl;
-    getchar();
-    glfwTerminate();
-    exit(1);
+#include "timestep.hpp"
+#include "frame_pacer.hpp"
+#include "replay.hpp"
+#include "window.hpp"
+
+struct Options {
+  double tick_rate = 60;
+  int max_ticks_per_frame = 16;
+  PacingMode pacing = PacingMode::fixed;
+  double fps = 0; // 0 - the monitor refresh rate
+  std::string record; // input recording to write
+  std::string replay; // input recording to replay, as fast as possible
+  SceneConfig scene;
+  GraphicsOptions graphics;
+};
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--tick-rate")
+      options.tick_rate = std::atof(argv[i + 1]);
+    else if (arg == "--max-ticks-per-frame")
+      options.max_ticks_per_frame = std::atoi(argv[i + 1]);
+    else if (arg == "--compact-vertices")
+      options.graphics.compact_vertices = std::atoi(argv[i + 1]) != 0;
+    else if (arg == "--instancing")
+      options.graphics.instancing = std::atoi(argv[i + 1]) != 0;
+    else if (arg == "--lod")
+      options.graphics.lod = std::atoi(argv[i + 1]) != 0;
+    else if (arg == "--pacing") {
+      if (!parsePacingMode(argv[i + 1], options.pacing))
+        std::cerr << "Unknown pacing mode " << argv[i + 1] << ", expected vsync, fixed or uncapped" << std::endl;
+    } else if (arg == "--fps")
+      options.fps = std::atof(argv[i + 1]);
+    else if (arg == "--max-enemies")
+      options.scene.max_enemies = std::strtoull(argv[i + 1], nullptr, 10);
+    else if (arg == "--spawn-delay")
+      options.scene.spawn_delay = std::atof(argv[i + 1]);
+    else if (arg == "--record")
+      options.record = argv[i + 1];
+    else if (arg == "--replay")
+      options.replay = argv[i + 1];
+    else
+      std::cerr << "Unknown option " << arg << std::endl;
   }
-
-  glfwMakeContextCurrent(window);
-
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-  if (glewInit() != GLEW_OK) {
-    fprintf(stderr, "Failed to initialize GLEW\n");
-    getchar();
-    glfwTerminate();
-    exit(1);
-  }
-  return window;
+  return options;
 }
 
-
-int main()
+int main(int argc, char **argv)
 {
+  auto startup_time = std::chrono::steady_clock::now();
+  Options options = parseOptions(argc, argv);
+
   GLFWwindow *window = initGlewGLFW();
 
   InputContext input{window};
   MouseInput::initGlobal(window, input.mouse_input);
 
-  Scene scene(&input, 42);
+  constexpr int64_t SCENE_SEED = 42;
+  Scene live_scene(&input, SCENE_SEED, options.scene);
+
+  // Replays take the seed, the config and every input from the recording
+  std::optional<replay::Player> player;
+  if (!options.replay.empty()) {
+    player.emplace(options.replay);
+    if (!player->valid()) {
+      std::cerr << "Cannot read recording " << options.replay << std::endl;
+      return 1;
+    }
+    options.pacing = PacingMode::uncapped;
+  }
+  Scene &scene = (player ? player->scene() : live_scene);
+
+  std::optional<replay::Recorder> recorder;
+  if (!options.record.empty() && !player) {
+    recorder.emplace(options.record, replay::makeHeader(SCENE_SEED, options.tick_rate, options.max_ticks_per_frame, options.scene));
+    if (!recorder->good())
+      std::cerr << "Cannot write recording " << options.record << std::endl;
+  }
 
+  static uint32_t clicks = 0; // since the last frame, for the recording
   static auto mouse_click_callback = [&](int button, int action) {
-    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !player) {
       scene.spawnProjectile();
+      clicks++;
+    }
   };
 
   glfwSetMouseButtonCallback(window, [](GLFWwindow* window, int button, int action, int mods) {
     mouse_click_callback(button, action);
   });
 
-  int targetFPS = 60;
-  double timePerFrame = 1.0 / targetFPS;
+  double fps = options.fps;
+  if (fps <= 0) {
+    const GLFWvidmode *video_mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    fps = (video_mode && video_mode->refreshRate > 0 ? video_mode->refreshRate : 60);
+  }
+#ifdef __EMSCRIPTEN__
+  options.pacing = PacingMode::vsync; // the browser paces frames with requestAnimationFrame
+#endif
+  static FramePacer pacer(options.pacing, fps);
+  glfwSwapInterval(pacer.swapInterval());
+
   double current_time = glfwGetTime();;
   double last_time = current_time;
   double game_time = 0;
   double frame_time = 0;
+  FixedTimestep timestep(options.tick_rate, options.max_ticks_per_frame);
 
-  Graphics graphics;
+  Graphics graphics(options.graphics);
   Graphics::initGlobal(graphics, window);
+  scene.profiler = &graphics.profiler;
+  scene.pool = &graphics.workers;
   graphics.prepare();
 
   UI ui(window);
 
   static double timeSpeed = 1;
+  static auto toggle_instancing = [&]() {
+    graphics.options.instancing = !graphics.options.instancing;
+  };
+  static auto toggle_lod = [&]() {
+    graphics.options.lod = !graphics.options.lod;
+  };
+  static auto save_trace = [&]() {
+    const char *path = "trace.json";
+    if (graphics.profiler.writeChromeTrace(path))
+      printf("Profiler trace written to %s\n", path);
+    else
+      fprintf(stderr, "Failed to write %s\n", path);
+  };
   glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (action != GLFW_PRESS)
       return;
@@ -145,32 +189,78 @@ int main()
       timeSpeed *= step;
     else if (key == GLFW_KEY_DOWN)
       timeSpeed /= step;
+    else if (key == GLFW_KEY_I)
+      toggle_instancing();
+    else if (key == GLFW_KEY_L)
+      toggle_lod();
+    else if (key == GLFW_KEY_P)
+      save_trace();
   });
 
+  auto replay_start = std::chrono::steady_clock::now();
   static std::function<void()> loop = [&]() {
     last_time = current_time;
 
-    game_time += frame_time * timeSpeed;
-    scene.update(frame_time * timeSpeed, game_time);
+    const FixedTimestep *ticked = &timestep;
+    if (player) {
+      if (!player->step()) {
+        replay::printReport(*player, std::chrono::duration<double>(std::chrono::steady_clock::now() - replay_start).count());
+        glfwSetWindowShouldClose(window, 1);
+        #ifdef __EMSCRIPTEN__
+        emscripten_cancel_main_loop();
+        #endif
+        return;
+      }
+      ticked = &player->timestep();
+      game_time = player->gameTime();
+      frame_time = player->frame().frame_time;
+      timeSpeed = player->frame().time_speed;
+    } else {
+      replay::Frame frame{frame_time, timeSpeed, clicks, input.poll(), std::nullopt};
+      clicks = 0;
+
+      int ticks = timestep.advance(frame_time * timeSpeed);
+      for (int i = 0; i < ticks; i++) {
+        game_time += timestep.tickDuration();
+        scene.update(timestep.tickDuration());
+      }
+
+      if (recorder) {
+        if (recorder->hashDue())
+          frame.state_hash = scene.stateHash();
+        recorder->write(frame);
+      }
+    }
+    double alpha = ticked->alpha();
+    double render_time = game_time - (1 - alpha) * ticked->tickDuration();
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    graphics.drawScene(game_time, scene);
-    ui.draw(frame_time, timeSpeed, scene);
+    graphics.drawScene(render_time, scene, (float)alpha);
+    ui.draw(frame_time, timeSpeed, scene, graphics, pacer);
 
     glfwSwapBuffers(window);
     glfwPollEvents();
+    graphics.profiler.endFrame();
+
+    static bool first_frame = true, assets_resident = false;
+    auto since_startup = [&]() {
+      return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup_time).count();
+    };
+    if (first_frame) {
+      printf("First frame after %.1f ms\n", since_startup());
+      first_frame = false;
+    }
+    if (!assets_resident && graphics.assets.done()) {
+      printf("All assets resident after %.1f ms\n", since_startup());
+      assets_resident = true;
+    }
 
-    current_time = glfwGetTime();
-    frame_time = current_time - last_time;
-    double free_time = std::max(timePerFrame - frame_time, 0.0);
-
-    // Sleep until next frame to keep FPS rate at the certain level
     #ifndef __EMSCRIPTEN__
-    if (free_time > 0) {
-      std::this_thread::sleep_for(std::chrono::duration<double>(free_time));
-    }
+    pacer.frameDone();
     #endif
+    current_time = glfwGetTime();
+    frame_time = current_time - last_time;
   };
 
 #ifdef __EMSCRIPTEN__
@@ -189,5 +279,5 @@ int main()
 
   glfwDestroyWindow(window);
   glfwTerminate();
-  return 0;
+  return (player && player->mismatches() ? 1 : 0);
 }
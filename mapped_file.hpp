@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifndef __EMSCRIPTEN__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Read-only view of a whole file: memory-mapped where possible,
+ * read into memory on platforms without mmap (emscripten).
+ */
+class MappedFile {
+ public:
+  MappedFile() = default;
+
+  explicit MappedFile(const std::string& path) {
+#ifndef __EMSCRIPTEN__
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat st = {};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *mapped = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        data_ = static_cast<const char*>(mapped);
+        size_ = (size_t)st.st_size;
+        mapped_ = true;
+      }
+    }
+    ::close(fd);
+    if (mapped_)
+      return;
+#endif
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin)
+      return;
+    buffer_.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    loaded_ = true;
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+  }
+
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+      release();
+      buffer_ = std::move(other.buffer_);
+      data_ = (other.mapped_ ? other.data_ : buffer_.data());
+      size_ = other.size_;
+      mapped_ = other.mapped_;
+      loaded_ = other.loaded_;
+      other.data_ = nullptr;
+      other.size_ = 0;
+      other.mapped_ = other.loaded_ = false;
+    }
+    return *this;
+  }
+
+  ~MappedFile() {
+    release();
+  }
+
+  [[nodiscard]] bool isOpen() const {
+    return mapped_ || loaded_;
+  }
+
+  [[nodiscard]] const char *data() const {
+    return data_;
+  }
+
+  [[nodiscard]] size_t size() const {
+    return size_;
+  }
+
+ private:
+  void release() {
+#ifndef __EMSCRIPTEN__
+    if (mapped_)
+      ::munmap(const_cast<char*>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = loaded_ = false;
+  }
+
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  bool loaded_ = false;
+  std::vector<char> buffer_;
+};
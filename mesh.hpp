@@ -1,77 +1,225 @@
 #pragma once
 
 #include <cassert>
-#include <cstdio>
-#include <fstream>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtx/rotate_vector.hpp>
+#include <glm/gtx/transform.hpp>
 #include <GL/glew.h>
 
-struct Mesh {
+#include "mesh_data.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimize.hpp"
+#include "obj_loader.hpp"
+
+/**
+ * Where each vertex attribute lives inside a vertex, for glVertexAttribPointer.
+ */
+struct VertexAttribute {
+  uint location;
+  int components;
+  GLenum type;
+  bool normalized;
+  size_t offset;
+  uint divisor = 0; // 1 for per-instance attributes
+};
+
+struct VertexLayout {
+  uint stride;
+  std::vector<VertexAttribute> attributes;
+
   /**
-   * VAO attributes:
-   * 0 - vec3 position
-   * 1 - vec3 color
-   * 2 - vec2 texture coords
-   * 3 - vec3 normals
+   * Locations:
+   * 0 - position
+   * 2 - texture coords
+   * 3 - normal (vec3, or an octahedral vec2 for the compact format)
    */
+  static VertexLayout of(VertexFormat format) {
+    if (format == VertexFormat::compact) {
+      return VertexLayout{sizeof(CompactVertex), {
+          {0, 3, GL_SHORT, true, offsetof(CompactVertex, pos)},
+          {2, 2, GL_HALF_FLOAT, false, offsetof(CompactVertex, tex_coord)},
+          {3, 2, GL_SHORT, true, offsetof(CompactVertex, normal)},
+      }};
+    }
+    return VertexLayout{sizeof(MeshVertex), {
+        {0, 3, GL_FLOAT, false, offsetof(MeshVertex, pos)},
+        {2, 2, GL_FLOAT, false, offsetof(MeshVertex, tex_coord)},
+        {3, 3, GL_FLOAT, false, offsetof(MeshVertex, normal)},
+    }};
+  }
 
-  struct Vertex {
-    glm::vec3 pos;
-    glm::vec3 color;
-    glm::vec2 tex_coord;
-    glm::vec3 normal;
-  };
-  static_assert(sizeof(Vertex) == sizeof(float) * 11);
+  static VertexLayout instances();
+
+  /**
+   * ExplosionVertex stream, locations 10-11.
+   */
+  static VertexLayout explosion() {
+    return VertexLayout{sizeof(ExplosionVertex), {
+        {10, 3, GL_FLOAT, false, offsetof(ExplosionVertex, centroid)},
+        {11, 4, GL_FLOAT, false, offsetof(ExplosionVertex, spin)},
+    }};
+  }
 
-  std::vector<Vertex> vertices;
-  std::vector<uint32_t> indices; // not used wisely
+  /**
+   * Points the attributes at the buffer bound to GL_ARRAY_BUFFER, starting `base_offset` bytes in.
+   */
+  void bind(size_t base_offset = 0) const {
+    for (const VertexAttribute& attribute : attributes) {
+      glEnableVertexAttribArray(attribute.location);
+      glVertexAttribPointer(attribute.location, attribute.components, attribute.type,
+                            attribute.normalized ? GL_TRUE : GL_FALSE, stride,
+                            reinterpret_cast<void*>(base_offset + attribute.offset));
+      if (attribute.divisor != 0)
+        glVertexAttribDivisor(attribute.location, attribute.divisor);
+    }
+  }
+};
+
+/**
+ * Per-instance attributes for Mesh::drawInstanced, locations 4-9.
+ * The explosion is the same one the per-draw path sets through uniforms; time 0 means intact.
+ */
+struct InstanceData {
+  glm::mat4 model;
+  glm::vec4 explosion_pos_time; // xyz - position, w - time since death
+  glm::vec4 explosion_dir_total; // xyz - direction, w - explosion duration
+};
+
+inline VertexLayout VertexLayout::instances() {
+  VertexLayout layout{sizeof(InstanceData), {}};
+  for (uint column = 0; column < 4; column++)
+    layout.attributes.push_back({4 + column, 4, GL_FLOAT, false, offsetof(InstanceData, model) + column * sizeof(glm::vec4), 1});
+  layout.attributes.push_back({8, 4, GL_FLOAT, false, offsetof(InstanceData, explosion_pos_time), 1});
+  layout.attributes.push_back({9, 4, GL_FLOAT, false, offsetof(InstanceData, explosion_dir_total), 1});
+  return layout;
+}
+
+struct Mesh {
+  using Vertex = MeshVertex;
+
+  size_t index_count = 0;
+  GLenum index_type = GL_UNSIGNED_INT;
+  // Index ranges of the levels of detail, finest first
+  uint32_t lod_count = 1;
+  MeshLod lods[MAX_MESH_LODS] = {};
+  // Maps stored positions to model space; not identity for quantized positions
+  glm::mat4 position_transform{1.0f};
+  MeshBounds bounds;
   uint vbo = 0;
   uint vao = 0;
   uint ebo = 0;
+  // Unshared copy for drawExploded, see bakeExplosion
+  size_t exploded_vertex_count = 0;
+  uint exploded_vbo = 0;
+  uint explosion_vbo = 0;
+  uint exploded_vao = 0;
 
   Mesh(const Mesh&) = delete;
   Mesh& operator=(const Mesh&) = delete;
 
+  Mesh(Mesh&& other) noexcept {
+    swap(other);
+  }
+
+  /**
+   * Replaces this mesh, e.g. a placeholder with the loaded asset; the old GL objects are freed.
+   */
+  Mesh& operator=(Mesh&& other) noexcept {
+    Mesh replaced(std::move(other));
+    swap(replaced);
+    return *this;
+  }
+
   ~Mesh() {
     glDeleteBuffers(1, &ebo);
     glDeleteBuffers(1, &vbo);
     glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &explosion_vbo);
+    glDeleteBuffers(1, &exploded_vbo);
+    glDeleteVertexArrays(1, &exploded_vao);
   }
 
-  Mesh(std::vector<Vertex> vertices_, std::vector<uint32_t> indices_) : vertices(std::move(vertices_)), indices(std::move(indices_)) {
+  Mesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+        : Mesh(fullView(vertices, indices)) {
+  }
+
+  explicit Mesh(const MeshData& data) : Mesh(data.vertices, data.indices) {
+  }
+
+  /**
+   * Uploads straight from the given memory (e.g. a mapped cache file), nothing is kept on the CPU side.
+   */
+  explicit Mesh(const PackedMeshView& mesh)
+        : index_count(mesh.index_count),
+          index_type(mesh.index_size == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT),
+          position_transform(glm::translate(mesh.position_offset) * glm::scale(glm::vec3(mesh.position_scale))),
+          bounds(mesh_optimize::bounds(mesh)) {
+    lod_count = mesh.levelCount();
+    for (uint32_t i = 0; i < lod_count; i++)
+      lods[i] = mesh.level(i);
+
     glGenBuffers(1, &vbo);
     glGenBuffers(1, &ebo);
     glGenVertexArrays(1, &vao);
 
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-      glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
+      glBufferData(GL_ARRAY_BUFFER, (size_t)mesh.vertex_count * mesh.vertex_stride, mesh.vertices, GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     // should not work, but
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), indices.data(), GL_STATIC_DRAW);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t)mesh.index_count * mesh.index_size, mesh.indices, GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
+    VertexLayout layout = VertexLayout::of(mesh.format);
+    assert(layout.stride == mesh.vertex_stride);
     glBindVertexArray(vao);
-      glEnableVertexAttribArray(0); // positions
-      glEnableVertexAttribArray(1); // colors
-      glEnableVertexAttribArray(2); // UVs
-      glEnableVertexAttribArray(3); // normals
-
       glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(0));
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(3 * sizeof(float)));
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(6 * sizeof(float)));
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(8 * sizeof(float)));
+        layout.bind();
       glBindBuffer(GL_ARRAY_BUFFER, 0);
 
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo); // indices
     glBindVertexArray(0);
   }
 
+  /**
+   * Uploads the explosion stream of `mesh`, which must be the data this Mesh was created from.
+   */
+  void bakeExplosion(const PackedMeshView& mesh) {
+    bakeExplosion(mesh_optimize::explode(mesh), mesh.format);
+  }
+
+  /**
+   * Uploads an explosion stream computed off the GL thread.
+   */
+  void bakeExplosion(const mesh_optimize::ExplodedMesh& exploded, VertexFormat format) {
+    exploded_vertex_count = exploded.explosion.size();
+
+    glGenBuffers(1, &exploded_vbo);
+    glGenBuffers(1, &explosion_vbo);
+    glGenVertexArrays(1, &exploded_vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, exploded_vbo);
+      glBufferData(GL_ARRAY_BUFFER, exploded.vertex_bytes.size(), exploded.vertex_bytes.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, explosion_vbo);
+      glBufferData(GL_ARRAY_BUFFER, exploded.explosion.size() * sizeof(ExplosionVertex), exploded.explosion.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(exploded_vao);
+      glBindBuffer(GL_ARRAY_BUFFER, exploded_vbo);
+        VertexLayout::of(format).bind();
+      glBindBuffer(GL_ARRAY_BUFFER, explosion_vbo);
+        VertexLayout::explosion().bind();
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+  }
+
   template <typename TFunc>
   static Mesh createMeshByVertexGenerator(size_t size, TFunc f) {
     std::vector<Vertex> vertices;
@@ -80,7 +228,7 @@ struct Mesh {
       vertices.push_back(f(i));
       indices.push_back(i);
     }
-    return Mesh(std::move(vertices), std::move(indices));
+    return Mesh(vertices, indices);
   }
 
   static Mesh fromPosUV(std::vector<glm::vec3> positions, std::vector<glm::vec2> uvs) {
@@ -99,7 +247,7 @@ struct Mesh {
       vertices.push_back(Vertex{positions[i]});
       indices.push_back(i);
     }
-    return Mesh(std::move(vertices), std::move(indices));
+    return Mesh(vertices, indices);
   }
 
   static Mesh fromPosNorm(
@@ -113,74 +261,143 @@ struct Mesh {
     });
   }
 
-  void draw() {
+  [[nodiscard]] size_t triangleCount(uint32_t lod = 0) const {
+    return lods[lod].index_count / 3;
+  }
+
+  void draw(uint32_t lod = 0) {
     glBindVertexArray(vao);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, lods[lod].index_count, index_type, indexOffset(lod));
+    glBindVertexArray(0);
+  }
+
+  /**
+   * Draws `instance_count` copies, taking InstanceData from `instance_buffer` starting `offset` bytes in.
+   * The instance attributes stay attached to the VAO; the per-draw shaders do not read them.
+   */
+  void drawInstanced(uint instance_buffer, size_t offset, size_t instance_count, uint32_t lod = 0) {
+    bindInstances(vao, instance_buffer, offset);
+    glDrawElementsInstanced(GL_TRIANGLES, lods[lod].index_count, index_type, indexOffset(lod), instance_count);
     glBindVertexArray(0);
   }
-};
 
+  /**
+   * Draws the explosion stream, for the EXPLODING shaders; falls back to draw() if it was not baked.
+   */
+  void drawExploded() {
+    if (!exploded_vao) {
+      draw();
+      return;
+    }
+    glBindVertexArray(exploded_vao);
+    glDrawArrays(GL_TRIANGLES, 0, exploded_vertex_count);
+    glBindVertexArray(0);
+  }
 
-Mesh loadSimpleObj(std::string path) {
-  std::ifstream fin(path);
-  assert(fin);
-  
-  std::vector<Mesh::Vertex> vertices;
-  std::vector<uint32_t> indices;
-
-  std::vector<glm::vec3> positions;
-  std::vector<glm::vec2> uvs;
-  std::vector<glm::vec3> normals;
-
-  while (fin) {
-    std::string kind;
-    if (!(fin >> kind))
-        break;
-    if (kind == "v") {
-      glm::vec3 pos;
-      fin >> pos.x >> pos.y >> pos.z;
-      positions.push_back(pos);
-    } else if (kind == "vt") {
-      glm::vec2 uv;
-      fin >> uv.x >> uv.y;
-      uvs.push_back(uv);
-    } else if (kind == "f") {
-      for (int i = 0; i < 3; i++) {
-        std::string vert_indices;
-        fin >> vert_indices;
-
-        int pos_idx, uv_idx, norm_idx;
-        int scanned = sscanf(vert_indices.c_str(), "%d/%d/%d", &pos_idx, &uv_idx, &norm_idx);
-        assert(scanned == 3);
-
-        Mesh::Vertex v = {};
-
-        assert(pos_idx - 1 < positions.size());
-        v.pos = positions[pos_idx - 1];
-
-        assert(uv_idx - 1 < uvs.size());
-        v.tex_coord = uvs[uv_idx - 1];
-
-        assert(norm_idx - 1 < normals.size());
-        v.normal = normals[norm_idx - 1];
-
-        vertices.push_back(v);
-        indices.push_back(indices.size());
-      }
-    } else if (kind == "vn") {
-      glm::vec3 norm;
-      fin >> norm.x >> norm.y >> norm.z;
-      normals.push_back(norm);
-    } else {
-        assert(kind == "o" || kind == "mtllib" || kind == "#" || kind == "usemtl" || kind == "s");
-        std::string line;
-        std::getline(fin, line);
-        // pass
+  void drawExplodedInstanced(uint instance_buffer, size_t offset, size_t instance_count) {
+    if (!exploded_vao) {
+      drawInstanced(instance_buffer, offset, instance_count);
+      return;
     }
-    assert(fin);
+    bindInstances(exploded_vao, instance_buffer, offset);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, exploded_vertex_count, instance_count);
+    glBindVertexArray(0);
+  }
+
+ private:
+  void swap(Mesh& other) noexcept {
+    std::swap(index_count, other.index_count);
+    std::swap(index_type, other.index_type);
+    std::swap(lod_count, other.lod_count);
+    std::swap(lods, other.lods);
+    std::swap(position_transform, other.position_transform);
+    std::swap(bounds, other.bounds);
+    std::swap(vbo, other.vbo);
+    std::swap(vao, other.vao);
+    std::swap(ebo, other.ebo);
+    std::swap(exploded_vertex_count, other.exploded_vertex_count);
+    std::swap(exploded_vbo, other.exploded_vbo);
+    std::swap(explosion_vbo, other.explosion_vbo);
+    std::swap(exploded_vao, other.exploded_vao);
   }
 
-  return Mesh(std::move(vertices), std::move(indices));
+  [[nodiscard]] const void *indexOffset(uint32_t lod) const {
+    size_t index_size = (index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+    return reinterpret_cast<const void*>((size_t)lods[lod].index_offset * index_size);
+  }
+
+  static void bindInstances(uint vertex_array, uint instance_buffer, size_t offset) {
+    static const VertexLayout instance_layout = VertexLayout::instances();
+    glBindVertexArray(vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+      instance_layout.bind(offset);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  static PackedMeshView fullView(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+    PackedMeshView view;
+    view.vertices = vertices.data();
+    view.vertex_count = (uint32_t)vertices.size();
+    view.vertex_stride = sizeof(Vertex);
+    view.indices = indices.data();
+    view.index_count = (uint32_t)indices.size();
+    return view;
+  }
+};
+
+
+/**
+ * CPU half of loadSimpleObj, safe to run off the GL thread: either a mapped cache or a freshly built mesh.
+ */
+struct MeshAsset {
+  std::optional<mesh_cache::CachedMesh> cached;
+  PackedMesh packed;
+  std::optional<mesh_optimize::ExplodedMesh> exploded;
+
+  [[nodiscard]] PackedMeshView view() const {
+    return cached ? cached->view() : packed.view();
+  }
+};
+
+/**
+ * Loads the binary cache next to the OBJ if it matches the OBJ contents,
+ * otherwise parses and optimizes the OBJ and (re)writes the cache.
+ * `explodable` meshes also get their explosion stream computed.
+ */
+MeshAsset readSimpleObj(const std::string& path, VertexFormat format = VertexFormat::full, bool explodable = false) {
+  MappedFile source(path);
+  assert(source.isOpen());
+  uint64_t source_hash = hashBytes(source.data(), source.size());
+
+  MeshAsset asset;
+  std::string cache_path = mesh_cache::cachePath(path, format);
+  asset.cached = mesh_cache::open(cache_path, source_hash);
+  if (!asset.cached) {
+    MeshData data = obj::parse(source.data(), source.data() + source.size());
+    assert(!data.vertices.empty());
+    mesh_optimize::Report report;
+    asset.packed = mesh_optimize::build(data, format, &report);
+    report.print(path);
+    if (!mesh_cache::write(cache_path, asset.packed.view(), source_hash))
+      std::cerr << "Failed to write mesh cache " << cache_path << std::endl;
+  }
+  if (explodable)
+    asset.exploded = mesh_optimize::explode(asset.view());
+  return asset;
+}
+
+/**
+ * GL half of loadSimpleObj.
+ */
+Mesh uploadMesh(const MeshAsset& asset) {
+  Mesh mesh(asset.view());
+  if (asset.exploded)
+    mesh.bakeExplosion(*asset.exploded, asset.view().format);
+  return mesh;
+}
+
+Mesh loadSimpleObj(const std::string& path, VertexFormat format = VertexFormat::full, bool explodable = false) {
+  return uploadMesh(readSimpleObj(path, format, explodable));
 }
 
 
@@ -209,6 +426,23 @@ Mesh genCube() {
   return Mesh::fromPos(genCubeVerts());
 }
 
+/**
+ * Unit cube with face normals, drawn in place of models that are still loading.
+ */
+Mesh genPlaceholderMesh() {
+  std::vector<glm::vec3> pts = genCubeVerts();
+  std::vector<glm::vec3> norms;
+  for (size_t i = 0; i < pts.size(); i += 3) {
+    glm::vec3 normal = glm::normalize(glm::cross(pts[i + 1] - pts[i], pts[i + 2] - pts[i]));
+    if (glm::dot(normal, pts[i]) < 0)
+      normal = -normal;
+    norms.insert(norms.end(), 3, normal);
+  }
+  for (glm::vec3 &p : pts)
+    p *= 0.5f;
+  return Mesh::fromPosNorm(pts, norms);
+}
+
 Mesh genSquareSurface() {
   std::vector<glm::vec3> pts;
 
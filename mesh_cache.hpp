@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "blob.hpp"
+#include "mapped_file.hpp"
+#include "mesh_data.hpp"
+
+/**
+ * Binary mesh cache: a header followed by the vertex and index blobs, ready to be
+ * memory-mapped and handed to glBufferData as is. Stored next to the source as
+ * `<source>[.compact].meshbin`, stamped with a hash of the source file so edits invalidate it.
+ * Files are written in native byte order; a version bump invalidates old caches.
+ */
+namespace mesh_cache {
+
+constexpr char MAGIC[4] = {'M', 'S', 'H', 'B'};
+constexpr uint32_t VERSION = 3;
+constexpr uint64_t BLOB_ALIGNMENT = 16;
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint64_t source_hash;
+
+  VertexFormat format;
+  uint32_t vertex_count;
+  uint32_t vertex_stride;
+  uint32_t index_count;
+  uint32_t index_size;
+  uint32_t reserved;
+
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+
+  glm::vec3 position_offset;
+  float position_scale;
+  glm::vec3 bounds_min;
+  glm::vec3 bounds_max;
+
+  uint32_t lod_count;
+  MeshLod lods[MAX_MESH_LODS];
+};
+
+inline std::string cachePath(const std::string &source_path, VertexFormat format) {
+  return source_path + (format == VertexFormat::compact ? ".compact" : "") + ".meshbin";
+}
+
+inline bool write(const std::string &path, const PackedMeshView &mesh, uint64_t source_hash) {
+  Header header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.source_hash = source_hash;
+  header.format = mesh.format;
+  header.vertex_count = mesh.vertex_count;
+  header.vertex_stride = mesh.vertex_stride;
+  header.index_count = mesh.index_count;
+  header.index_size = mesh.index_size;
+  header.vertex_offset = alignUp(sizeof(Header), BLOB_ALIGNMENT);
+  header.index_offset = alignUp(header.vertex_offset + (uint64_t)header.vertex_count * header.vertex_stride, BLOB_ALIGNMENT);
+  header.position_offset = mesh.position_offset;
+  header.position_scale = mesh.position_scale;
+  header.bounds_min = mesh.bounds_min;
+  header.bounds_max = mesh.bounds_max;
+  header.lod_count = mesh.lod_count;
+  std::copy(mesh.lods, mesh.lods + MAX_MESH_LODS, header.lods);
+
+  std::ofstream fout(path, std::ios::binary | std::ios::trunc);
+  if (!fout)
+    return false;
+
+  auto padTo = [&](uint64_t offset) {
+    static const char zeros[BLOB_ALIGNMENT] = {};
+    fout.write(zeros, (std::streamsize)(offset - (uint64_t)fout.tellp()));
+  };
+  fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  padTo(header.vertex_offset);
+  fout.write(static_cast<const char*>(mesh.vertices), (std::streamsize)((uint64_t)mesh.vertex_count * mesh.vertex_stride));
+  padTo(header.index_offset);
+  fout.write(static_cast<const char*>(mesh.indices), (std::streamsize)((uint64_t)mesh.index_count * mesh.index_size));
+  return (bool)fout;
+}
+
+/**
+ * A memory-mapped cache file. Pointers stay valid while the object lives.
+ */
+class CachedMesh {
+ public:
+  explicit CachedMesh(MappedFile file) : file_(std::move(file)) {
+  }
+
+  [[nodiscard]] const Header &header() const {
+    return *reinterpret_cast<const Header*>(file_.data());
+  }
+
+  [[nodiscard]] PackedMeshView view() const {
+    const Header &h = header();
+    PackedMeshView result;
+    result.format = h.format;
+    result.vertices = file_.data() + h.vertex_offset;
+    result.vertex_count = h.vertex_count;
+    result.vertex_stride = h.vertex_stride;
+    result.indices = file_.data() + h.index_offset;
+    result.index_count = h.index_count;
+    result.index_size = h.index_size;
+    result.position_offset = h.position_offset;
+    result.position_scale = h.position_scale;
+    result.bounds_min = h.bounds_min;
+    result.bounds_max = h.bounds_max;
+    result.lod_count = h.lod_count;
+    std::copy(h.lods, h.lods + MAX_MESH_LODS, result.lods);
+    return result;
+  }
+
+ private:
+  MappedFile file_;
+};
+
+/**
+ * Maps the cache file if it exists, is well-formed and was built from a source with `source_hash`.
+ */
+inline std::optional<CachedMesh> open(const std::string &path, uint64_t source_hash) {
+  MappedFile file(path);
+  if (!file.isOpen() || file.size() < sizeof(Header))
+    return std::nullopt;
+
+  Header header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  bool valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+      && header.version == VERSION
+      && header.source_hash == source_hash
+      && header.vertex_stride == (header.format == VertexFormat::compact ? sizeof(CompactVertex) : sizeof(MeshVertex))
+      && (header.index_size == sizeof(uint16_t) || header.index_size == sizeof(uint32_t))
+      && header.vertex_offset + (uint64_t)header.vertex_count * header.vertex_stride <= file.size()
+      && header.index_offset + (uint64_t)header.index_count * header.index_size <= file.size()
+      && header.lod_count <= MAX_MESH_LODS;
+  for (uint32_t i = 0; valid && i < header.lod_count; i++)
+    valid = (uint64_t)header.lods[i].index_offset + header.lods[i].index_count <= header.index_count;
+  if (!valid)
+    return std::nullopt;
+  return CachedMesh(std::move(file));
+}
+
+} // namespace mesh_cache
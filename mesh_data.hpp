@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+ * CPU-side mesh data, independent of GL so loaders and tools can use it headless.
+ */
+struct MeshVertex {
+  glm::vec3 pos;
+  glm::vec2 tex_coord;
+  glm::vec3 normal;
+};
+static_assert(sizeof(MeshVertex) == sizeof(float) * 8);
+
+struct MeshData {
+  std::vector<MeshVertex> vertices;
+  std::vector<uint32_t> indices;
+};
+
+/**
+ * GPU vertex formats:
+ * full    - MeshVertex as is, 32 bytes
+ * compact - CompactVertex, 16 bytes: snorm16 positions relative to the mesh bounds,
+ *           half-float UVs, octahedral snorm16 normals
+ */
+enum class VertexFormat : uint32_t { full = 0, compact = 1 };
+
+struct CompactVertex {
+  int16_t pos[4]; // xyz + padding
+  uint32_t tex_coord; // packHalf2x16
+  int16_t normal[2]; // octahedral
+};
+static_assert(sizeof(CompactVertex) == 16);
+
+constexpr uint32_t MAX_MESH_LODS = 4;
+
+/**
+ * One level of detail: a range of the index buffer. All levels share the vertices.
+ * `error` is how far the level may deviate from the full mesh, in model units.
+ */
+struct MeshLod {
+  uint32_t index_offset = 0;
+  uint32_t index_count = 0;
+  float error = 0;
+};
+
+/**
+ * Mesh ready for upload: packed vertices and 16 or 32-bit indices.
+ * Positions decode as position_offset + stored * position_scale (identity for the full format).
+ * The index buffer holds lod_count levels, finest first; with lod_count 0 it is one level.
+ */
+struct PackedMeshView {
+  VertexFormat format = VertexFormat::full;
+  const void *vertices = nullptr;
+  uint32_t vertex_count = 0;
+  uint32_t vertex_stride = 0;
+  const void *indices = nullptr;
+  uint32_t index_count = 0;
+  uint32_t index_size = 4;
+  glm::vec3 position_offset{0, 0, 0};
+  float position_scale = 1;
+  glm::vec3 bounds_min{0, 0, 0};
+  glm::vec3 bounds_max{0, 0, 0};
+  uint32_t lod_count = 0;
+  MeshLod lods[MAX_MESH_LODS] = {};
+
+  [[nodiscard]] uint32_t levelCount() const {
+    return lod_count ? lod_count : 1;
+  }
+
+  [[nodiscard]] MeshLod level(uint32_t lod) const {
+    return lod_count ? lods[lod] : MeshLod{0, index_count, 0};
+  }
+};
+
+/**
+ * Model space bounds: a box and a sphere around the box center.
+ */
+struct MeshBounds {
+  glm::vec3 min{0, 0, 0};
+  glm::vec3 max{0, 0, 0};
+  glm::vec3 center{0, 0, 0};
+  float radius = 0;
+};
+
+struct PackedMesh {
+  PackedMeshView layout; // pointers are filled in by view()
+  std::vector<uint8_t> vertex_bytes;
+  std::vector<uint8_t> index_bytes;
+
+  [[nodiscard]] PackedMeshView view() const {
+    PackedMeshView result = layout;
+    result.vertices = vertex_bytes.data();
+    result.indices = index_bytes.data();
+    return result;
+  }
+};
+
+/**
+ * Per face corner attributes for exploding a mesh in the vertex shader: every triangle gets
+ * its own three vertices, each carrying the triangle's centroid and spin.
+ */
+struct ExplosionVertex {
+  glm::vec3 centroid; // in stored position space, like the vertex positions
+  glm::vec4 spin; // xyz - rotation axis, w - rotation speed
+};
+static_assert(sizeof(ExplosionVertex) == sizeof(float) * 7);
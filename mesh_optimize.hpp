@@ -0,0 +1,432 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "mesh_data.hpp"
+#include "mesh_simplify.hpp"
+
+/**
+ * Turns the one-vertex-per-face-corner output of the OBJ loader into an
+ * upload-ready mesh: welds identical vertices, builds simplified levels of
+ * detail, orders triangles for the post-transform vertex cache, orders
+ * vertices by first use, and packs them.
+ */
+namespace mesh_optimize {
+
+constexpr int VERTEX_CACHE_SIZE = 32;
+
+struct VertexKeyHash {
+  size_t operator()(const MeshVertex &v) const {
+    uint32_t words[sizeof(MeshVertex) / 4];
+    std::memcpy(words, &v, sizeof(v));
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (uint32_t w : words)
+      h = (h ^ w) * 0x100000001B3ull;
+    return (size_t)h;
+  }
+};
+
+struct VertexKeyEqual {
+  bool operator()(const MeshVertex &a, const MeshVertex &b) const {
+    return std::memcmp(&a, &b, sizeof(MeshVertex)) == 0;
+  }
+};
+
+/**
+ * Merges bitwise identical vertices.
+ */
+inline MeshData deduplicate(const MeshData &data) {
+  MeshData result;
+  std::unordered_map<MeshVertex, uint32_t, VertexKeyHash, VertexKeyEqual> seen;
+  seen.reserve(data.vertices.size());
+  result.indices.reserve(data.indices.size());
+  for (uint32_t index : data.indices) {
+    const MeshVertex &v = data.vertices[index];
+    auto [it, inserted] = seen.emplace(v, (uint32_t)result.vertices.size());
+    if (inserted)
+      result.vertices.push_back(v);
+    result.indices.push_back(it->second);
+  }
+  return result;
+}
+
+/**
+ * Average cache miss ratio (misses per triangle) for a FIFO cache of the given size.
+ */
+inline double acmr(const std::vector<uint32_t> &indices, size_t vertex_count, int cache_size = VERTEX_CACHE_SIZE) {
+  if (indices.empty())
+    return 0;
+  std::vector<int64_t> inserted_at(vertex_count, -cache_size - 1);
+  int64_t clock = 0;
+  size_t misses = 0;
+  for (uint32_t index : indices) {
+    if (clock - inserted_at[index] > cache_size) {
+      inserted_at[index] = clock++;
+      misses++;
+    }
+  }
+  return (double)misses / (indices.size() / 3);
+}
+
+/**
+ * Tom Forsyth's linear-speed vertex cache optimisation: greedily emits the
+ * triangle with the best score, where recently used vertices and vertices with
+ * few remaining triangles score higher.
+ */
+inline std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t> &indices, size_t vertex_count) {
+  constexpr float CACHE_DECAY_POWER = 1.5f;
+  constexpr float LAST_TRI_SCORE = 0.75f;
+  constexpr float VALENCE_BOOST_SCALE = 2.0f;
+  constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+  size_t tri_count = indices.size() / 3;
+
+  std::vector<uint32_t> adjacency_start(vertex_count + 1, 0);
+  for (uint32_t index : indices)
+    adjacency_start[index + 1]++;
+  for (size_t v = 0; v < vertex_count; v++)
+    adjacency_start[v + 1] += adjacency_start[v];
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> remaining(vertex_count, 0);
+  for (size_t t = 0; t < tri_count; t++) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = indices[t * 3 + k];
+      adjacency[adjacency_start[v] + remaining[v]++] = (uint32_t)t;
+    }
+  }
+
+  std::vector<int> cache_position(vertex_count, -1);
+  auto vertexScore = [&](uint32_t v) {
+    if (remaining[v] == 0)
+      return -1.0f;
+    float score = 0;
+    int position = cache_position[v];
+    if (position >= 0) {
+      if (position < 3) {
+        score = LAST_TRI_SCORE;
+      } else {
+        float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+        score = std::pow(1.0f - (position - 3) * scaler, CACHE_DECAY_POWER);
+      }
+    }
+    return score + VALENCE_BOOST_SCALE * std::pow((float)remaining[v], -VALENCE_BOOST_POWER);
+  };
+
+  std::vector<float> vertex_score(vertex_count);
+  for (uint32_t v = 0; v < vertex_count; v++)
+    vertex_score[v] = vertexScore(v);
+
+  std::vector<float> tri_score(tri_count);
+  std::vector<char> emitted(tri_count, false);
+  for (size_t t = 0; t < tri_count; t++)
+    tri_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  std::vector<uint32_t> cache, next_cache;
+  size_t scan_from = 0;
+
+  int64_t best = tri_count > 0 ? (int64_t)(std::max_element(tri_score.begin(), tri_score.end()) - tri_score.begin()) : -1;
+  while (best >= 0) {
+    emitted[best] = true;
+    const uint32_t *tri = &indices[best * 3];
+    next_cache.assign(tri, tri + 3);
+
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = tri[k];
+      result.push_back(v);
+      // Drop the triangle from the vertex's list of remaining triangles
+      uint32_t *begin = &adjacency[adjacency_start[v]];
+      uint32_t *end = begin + remaining[v];
+      std::iter_swap(std::find(begin, end, (uint32_t)best), end - 1);
+      remaining[v]--;
+    }
+
+    for (uint32_t v : cache) {
+      if (v != tri[0] && v != tri[1] && v != tri[2])
+        next_cache.push_back(v);
+    }
+    for (uint32_t v : cache)
+      cache_position[v] = -1;
+    for (size_t i = 0; i < next_cache.size(); i++)
+      cache_position[next_cache[i]] = (i < (size_t)VERTEX_CACHE_SIZE ? (int)i : -1);
+
+    // Rescore everything that was or is in the cache, and their triangles
+    best = -1;
+    float best_score = -1;
+    for (uint32_t v : next_cache) {
+      vertex_score[v] = vertexScore(v);
+    }
+    for (uint32_t v : next_cache) {
+      for (uint32_t i = 0; i < remaining[v]; i++) {
+        uint32_t t = adjacency[adjacency_start[v] + i];
+        tri_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+        if (tri_score[t] > best_score) {
+          best_score = tri_score[t];
+          best = t;
+        }
+      }
+    }
+
+    if (next_cache.size() > (size_t)VERTEX_CACHE_SIZE)
+      next_cache.resize(VERTEX_CACHE_SIZE);
+    std::swap(cache, next_cache);
+
+    if (best < 0) {
+      while (scan_from < tri_count && emitted[scan_from])
+        scan_from++;
+      best = (scan_from < tri_count ? (int64_t)scan_from : -1);
+    }
+  }
+  return result;
+}
+
+/**
+ * Renumbers vertices in order of first use, so vertex fetches walk memory forward.
+ */
+inline MeshData optimizeVertexFetch(const MeshData &data) {
+  MeshData result;
+  std::vector<uint32_t> remap(data.vertices.size(), UINT32_MAX);
+  result.vertices.reserve(data.vertices.size());
+  result.indices.reserve(data.indices.size());
+  for (uint32_t index : data.indices) {
+    if (remap[index] == UINT32_MAX) {
+      remap[index] = (uint32_t)result.vertices.size();
+      result.vertices.push_back(data.vertices[index]);
+    }
+    result.indices.push_back(remap[index]);
+  }
+  return result;
+}
+
+inline int16_t toSnorm16(float value) {
+  return (int16_t)std::lround(glm::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+inline glm::vec2 octahedralEncode(glm::vec3 n) {
+  n /= (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+  glm::vec2 e{n.x, n.y};
+  if (n.z < 0) {
+    e = glm::vec2{
+        (1.0f - std::abs(n.y)) * (n.x >= 0 ? 1.0f : -1.0f),
+        (1.0f - std::abs(n.x)) * (n.y >= 0 ? 1.0f : -1.0f)
+    };
+  }
+  return e;
+}
+
+struct Report {
+  size_t corner_count = 0;
+  size_t vertex_count = 0;
+  size_t naive_bytes = 0; // one 44-byte vertex per corner + 32-bit indices, as loadSimpleObj used to upload
+  size_t packed_bytes = 0;
+  double acmr_before = 0;
+  double acmr_after = 0; // of the finest level
+  std::vector<MeshLod> lods;
+
+  void print(const std::string &name) const {
+    std::printf("%s: %zu corners -> %zu vertices, %zu -> %zu bytes, ACMR %.2f -> %.2f\n",
+                name.c_str(), corner_count, vertex_count, naive_bytes, packed_bytes, acmr_before, acmr_after);
+    for (size_t i = 0; i < lods.size(); i++)
+      std::printf("  LOD %zu: %u triangles, error %g\n", i, lods[i].index_count / 3, lods[i].error);
+  }
+};
+
+constexpr size_t MIN_LOD_TRIANGLES = 16;
+
+/**
+ * Each level aims at half the triangles of the previous one.
+ */
+inline std::vector<mesh_simplify::Level> buildLods(const MeshData &welded) {
+  std::vector<mesh_simplify::Level> levels{{welded.indices, 0.0f}};
+  std::vector<size_t> targets;
+  size_t triangles = welded.indices.size() / 3;
+  while (targets.size() + 1 < MAX_MESH_LODS && triangles / 2 >= MIN_LOD_TRIANGLES)
+    targets.push_back(triangles /= 2);
+  for (mesh_simplify::Level &level : mesh_simplify::simplify(welded.vertices, welded.indices, targets))
+    levels.push_back(std::move(level));
+  return levels;
+}
+
+/**
+ * Full pipeline: weld, simplify into levels of detail, reorder, pack vertices into `format`,
+ * use 16-bit indices when they fit.
+ */
+inline PackedMesh build(const MeshData &raw, VertexFormat format, Report *report = nullptr) {
+  MeshData welded = deduplicate(raw);
+  std::vector<uint32_t> acmr_input = welded.indices;
+
+  // Levels go one after another into one index buffer over the shared vertices
+  PackedMesh packed;
+  PackedMeshView &layout = packed.layout;
+  std::vector<mesh_simplify::Level> levels = buildLods(welded);
+  welded.indices.clear();
+  for (const mesh_simplify::Level &level : levels) {
+    MeshLod &lod = layout.lods[layout.lod_count++];
+    lod.index_offset = (uint32_t)welded.indices.size();
+    lod.index_count = (uint32_t)level.indices.size();
+    lod.error = level.error;
+    std::vector<uint32_t> ordered = optimizeVertexCache(level.indices, welded.vertices.size());
+    welded.indices.insert(welded.indices.end(), ordered.begin(), ordered.end());
+  }
+  MeshData mesh = optimizeVertexFetch(welded);
+
+  layout.format = format;
+  layout.vertex_count = (uint32_t)mesh.vertices.size();
+  layout.index_count = (uint32_t)mesh.indices.size();
+
+  if (!mesh.vertices.empty()) {
+    layout.bounds_min = layout.bounds_max = mesh.vertices[0].pos;
+    for (const MeshVertex &v : mesh.vertices) {
+      layout.bounds_min = glm::min(layout.bounds_min, v.pos);
+      layout.bounds_max = glm::max(layout.bounds_max, v.pos);
+    }
+  }
+
+  if (format == VertexFormat::full) {
+    layout.vertex_stride = sizeof(MeshVertex);
+    packed.vertex_bytes.resize(mesh.vertices.size() * sizeof(MeshVertex));
+    std::memcpy(packed.vertex_bytes.data(), mesh.vertices.data(), packed.vertex_bytes.size());
+  } else {
+    // One uniform scale for all axes, so the decode transform keeps normals' directions
+    glm::vec3 center = (layout.bounds_min + layout.bounds_max) * 0.5f;
+    glm::vec3 half_extent = (layout.bounds_max - layout.bounds_min) * 0.5f;
+    float scale = std::max({half_extent.x, half_extent.y, half_extent.z, 1e-6f});
+    layout.position_offset = center;
+    layout.position_scale = scale;
+
+    layout.vertex_stride = sizeof(CompactVertex);
+    packed.vertex_bytes.resize(mesh.vertices.size() * sizeof(CompactVertex));
+    auto *out = reinterpret_cast<CompactVertex*>(packed.vertex_bytes.data());
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+      const MeshVertex &v = mesh.vertices[i];
+      glm::vec3 p = (v.pos - center) / scale;
+      glm::vec2 n = octahedralEncode(glm::length(v.normal) > 0 ? v.normal : glm::vec3{0, 0, 1});
+      out[i] = CompactVertex{
+          {toSnorm16(p.x), toSnorm16(p.y), toSnorm16(p.z), 0},
+          glm::packHalf2x16(v.tex_coord),
+          {toSnorm16(n.x), toSnorm16(n.y)}
+      };
+    }
+  }
+
+  if (mesh.vertices.size() <= UINT16_MAX) {
+    layout.index_size = sizeof(uint16_t);
+    std::vector<uint16_t> short_indices(mesh.indices.begin(), mesh.indices.end());
+    packed.index_bytes.resize(short_indices.size() * sizeof(uint16_t));
+    std::memcpy(packed.index_bytes.data(), short_indices.data(), packed.index_bytes.size());
+  } else {
+    layout.index_size = sizeof(uint32_t);
+    packed.index_bytes.resize(mesh.indices.size() * sizeof(uint32_t));
+    std::memcpy(packed.index_bytes.data(), mesh.indices.data(), packed.index_bytes.size());
+  }
+
+  if (report) {
+    report->corner_count = raw.indices.size();
+    report->vertex_count = mesh.vertices.size();
+    report->naive_bytes = raw.indices.size() * (44 + sizeof(uint32_t));
+    report->packed_bytes = packed.vertex_bytes.size() + packed.index_bytes.size();
+    report->acmr_before = acmr(acmr_input, welded.vertices.size());
+    std::vector<uint32_t> finest(mesh.indices.begin(), mesh.indices.begin() + layout.lods[0].index_count);
+    report->acmr_after = acmr(finest, mesh.vertices.size());
+    report->lods.assign(layout.lods, layout.lods + layout.lod_count);
+  }
+  return packed;
+}
+
+/**
+ * Position of vertex `index` as stored, i.e. before position_transform.
+ */
+inline glm::vec3 storedPosition(const PackedMeshView &mesh, uint32_t index) {
+  const auto *vertex = static_cast<const uint8_t*>(mesh.vertices) + (size_t)index * mesh.vertex_stride;
+  if (mesh.format == VertexFormat::full) {
+    MeshVertex v;
+    std::memcpy(&v, vertex, sizeof(v));
+    return v.pos;
+  }
+  CompactVertex v;
+  std::memcpy(&v, vertex, sizeof(v));
+  // Same as GL's snorm16 normalization
+  return glm::max(glm::vec3{v.pos[0], v.pos[1], v.pos[2]} / 32767.0f, glm::vec3(-1.0f));
+}
+
+inline uint32_t indexAt(const PackedMeshView &mesh, size_t i) {
+  if (mesh.index_size == sizeof(uint16_t))
+    return static_cast<const uint16_t*>(mesh.indices)[i];
+  return static_cast<const uint32_t*>(mesh.indices)[i];
+}
+
+/**
+ * Bounds of the decoded (model space) positions.
+ */
+inline MeshBounds bounds(const PackedMeshView &mesh) {
+  MeshBounds result;
+  if (mesh.vertex_count == 0)
+    return result;
+  std::vector<glm::vec3> positions(mesh.vertex_count);
+  for (uint32_t i = 0; i < mesh.vertex_count; i++)
+    positions[i] = mesh.position_offset + storedPosition(mesh, i) * mesh.position_scale;
+
+  result.min = result.max = positions[0];
+  for (const glm::vec3 &p : positions) {
+    result.min = glm::min(result.min, p);
+    result.max = glm::max(result.max, p);
+  }
+  result.center = (result.min + result.max) * 0.5f;
+  for (const glm::vec3 &p : positions)
+    result.radius = std::max(result.radius, glm::length(p - result.center));
+  return result;
+}
+
+/**
+ * The finest level with no shared vertices, for exploding it triangle by triangle:
+ * the vertices of every triangle in index order, in the mesh's format, plus one
+ * ExplosionVertex per corner.
+ */
+struct ExplodedMesh {
+  std::vector<uint8_t> vertex_bytes;
+  std::vector<ExplosionVertex> explosion;
+};
+
+/**
+ * The spin is the pseudo-random function of the triangle index the explosion geometry
+ * shader computed from gl_PrimitiveIDIn, so pieces tumble as they used to.
+ */
+inline ExplodedMesh explode(const PackedMeshView &mesh) {
+  MeshLod finest = mesh.level(0);
+  ExplodedMesh result;
+  result.vertex_bytes.resize((size_t)finest.index_count * mesh.vertex_stride);
+  result.explosion.resize(finest.index_count);
+
+  const auto *vertices = static_cast<const uint8_t*>(mesh.vertices);
+  for (size_t triangle = 0; triangle < finest.index_count / 3; triangle++) {
+    glm::vec3 centroid{0, 0, 0};
+    for (size_t corner = triangle * 3; corner < triangle * 3 + 3; corner++) {
+      uint32_t index = indexAt(mesh, finest.index_offset + corner);
+      std::memcpy(&result.vertex_bytes[corner * mesh.vertex_stride],
+                  vertices + (size_t)index * mesh.vertex_stride, mesh.vertex_stride);
+      centroid += storedPosition(mesh, index);
+    }
+    centroid /= 3.0f;
+
+    float pseudorandom = (float)triangle;
+    glm::vec3 axis = glm::normalize(glm::vec3{
+        std::sin(pseudorandom * 10), std::cos(pseudorandom * 20), std::sin(pseudorandom * 30)});
+    float speed = (std::cos(pseudorandom * 30) + 1) * 10;
+    for (size_t corner = triangle * 3; corner < triangle * 3 + 3; corner++)
+      result.explosion[corner] = ExplosionVertex{centroid, glm::vec4(axis, speed)};
+  }
+  return result;
+}
+
+} // namespace mesh_optimize
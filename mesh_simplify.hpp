@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+
+/**
+ * Quadric error metric simplification (Garland & Heckbert) by half-edge collapse:
+ * a position is merged into a neighbouring one, whose vertices keep their own UVs and
+ * normals, so the simplified levels index a subset of the original vertices and can
+ * share one vertex buffer.
+ *
+ * Attribute seams (several welded vertices at one position) only collapse along the
+ * seam: every vertex at the removed position must have a partner at the kept position
+ * on its side of the seam. Open borders never move.
+ */
+namespace mesh_simplify {
+
+/**
+ * Symmetric 4x4 matrix: the sum of squared distances to a set of planes.
+ */
+struct Quadric {
+  double a[10] = {};
+
+  /**
+   * The plane dot(n, v) + d = 0, `n` of unit length.
+   */
+  static Quadric plane(const glm::vec3 &n, double d) {
+    double x = n.x, y = n.y, z = n.z;
+    Quadric q;
+    q.a[0] = x * x; q.a[1] = x * y; q.a[2] = x * z; q.a[3] = x * d;
+    q.a[4] = y * y; q.a[5] = y * z; q.a[6] = y * d;
+    q.a[7] = z * z; q.a[8] = z * d;
+    q.a[9] = d * d;
+    return q;
+  }
+
+  Quadric &operator+=(const Quadric &other) {
+    for (int i = 0; i < 10; i++)
+      a[i] += other.a[i];
+    return *this;
+  }
+
+  [[nodiscard]] double error(const glm::vec3 &v) const {
+    double x = v.x, y = v.y, z = v.z;
+    return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+         + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+         + a[7] * z * z + 2 * a[8] * z
+         + a[9];
+  }
+};
+
+/**
+ * A simplified level: triangle list over the input vertices and the largest
+ * collapse error so far, as a distance in model units.
+ */
+struct Level {
+  std::vector<uint32_t> indices;
+  float error = 0;
+};
+
+/**
+ * Simplifies `indices` (a welded triangle list) once, recording a Level each time the
+ * triangle count drops to the next of `target_triangles` (descending). Stops early when
+ * no collapse is left; the missing levels are then not returned.
+ */
+inline std::vector<Level> simplify(const std::vector<MeshVertex> &vertices, const std::vector<uint32_t> &indices,
+                                   const std::vector<size_t> &target_triangles) {
+  size_t vertex_count = vertices.size();
+  size_t tri_count = indices.size() / 3;
+  std::vector<std::array<uint32_t, 3>> tris(tri_count);
+  std::vector<bool> tri_removed(tri_count, false);
+  std::vector<std::vector<uint32_t>> vertex_tris(vertex_count);
+  for (uint32_t t = 0; t < tri_count; t++) {
+    for (int k = 0; k < 3; k++) {
+      tris[t][k] = indices[t * 3 + k];
+      vertex_tris[tris[t][k]].push_back(t);
+    }
+  }
+
+  // Collapses work on positions; welded vertices that differ only in attributes share one
+  std::vector<uint32_t> position_id(vertex_count);
+  std::vector<glm::vec3> positions;
+  {
+    struct PosHash {
+      size_t operator()(const glm::vec3 &p) const {
+        uint32_t w[3];
+        std::memcpy(w, &p, sizeof(w));
+        return (size_t)(((uint64_t)w[0] * 0x9E3779B1u) ^ ((uint64_t)w[1] * 0x85EBCA77u) ^ ((uint64_t)w[2] * 0xC2B2AE3Du));
+      }
+    };
+    std::unordered_map<glm::vec3, uint32_t, PosHash> ids;
+    for (size_t v = 0; v < vertex_count; v++) {
+      auto inserted = ids.emplace(vertices[v].pos, (uint32_t)positions.size());
+      if (inserted.second)
+        positions.push_back(vertices[v].pos);
+      position_id[v] = inserted.first->second;
+    }
+  }
+  size_t position_count = positions.size();
+  std::vector<std::vector<uint32_t>> position_vertices(position_count);
+  for (uint32_t v = 0; v < vertex_count; v++)
+    position_vertices[position_id[v]].push_back(v);
+
+  auto edgeKey = [&](uint32_t pa, uint32_t pb) {
+    return ((uint64_t)std::min(pa, pb) << 32) | std::max(pa, pb);
+  };
+  std::vector<bool> locked(position_count, false);
+  {
+    // Borders: edges with a single triangle
+    std::unordered_map<uint64_t, uint32_t> edge_use;
+    for (const auto &tri : tris) {
+      for (int k = 0; k < 3; k++)
+        edge_use[edgeKey(position_id[tri[k]], position_id[tri[(k + 1) % 3]])]++;
+    }
+    for (const auto &tri : tris) {
+      for (int k = 0; k < 3; k++) {
+        uint32_t pa = position_id[tri[k]], pb = position_id[tri[(k + 1) % 3]];
+        if (edge_use[edgeKey(pa, pb)] == 1)
+          locked[pa] = locked[pb] = true;
+      }
+    }
+  }
+
+  auto faceNormal = [&](const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+    return glm::cross(b - a, c - a);
+  };
+
+  std::vector<Quadric> quadrics(position_count);
+  for (const auto &tri : tris) {
+    glm::vec3 a = positions[position_id[tri[0]]], b = positions[position_id[tri[1]]], c = positions[position_id[tri[2]]];
+    glm::vec3 n = faceNormal(a, b, c);
+    float length = glm::length(n);
+    if (length == 0)
+      continue;
+    n /= length;
+    Quadric q = Quadric::plane(n, -glm::dot(n, a));
+    for (uint32_t v : tri)
+      quadrics[position_id[v]] += q;
+  }
+
+  struct Collapse {
+    double cost;
+    uint32_t from, to; // positions
+    uint32_t from_stamp, to_stamp;
+    bool operator>(const Collapse &other) const {
+      return cost > other.cost;
+    }
+  };
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+  std::vector<uint32_t> stamp(position_count, 0);
+  std::vector<bool> position_removed(position_count, false);
+
+  auto pushCollapse = [&](uint32_t from, uint32_t to) {
+    if (locked[from] || from == to)
+      return;
+    Quadric q = quadrics[from];
+    q += quadrics[to];
+    heap.push({std::max(q.error(positions[to]), 0.0), from, to, stamp[from], stamp[to]});
+  };
+  for (const auto &tri : tris) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t pa = position_id[tri[k]], pb = position_id[tri[(k + 1) % 3]];
+      pushCollapse(pa, pb);
+      pushCollapse(pb, pa);
+    }
+  }
+
+  auto hasPosition = [&](const std::array<uint32_t, 3> &tri, uint32_t p) {
+    return position_id[tri[0]] == p || position_id[tri[1]] == p || position_id[tri[2]] == p;
+  };
+
+  // For every vertex at `from`, the vertex at `to` it merges into (one sharing a triangle
+  // with it). Fails if some vertex has none, or if a remaining triangle would flip.
+  std::vector<std::pair<uint32_t, uint32_t>> merges;
+  auto planCollapse = [&](uint32_t from, uint32_t to) {
+    merges.clear();
+    for (uint32_t u : position_vertices[from]) {
+      uint32_t partner = UINT32_MAX;
+      for (uint32_t t : vertex_tris[u]) {
+        if (tri_removed[t])
+          continue;
+        const auto &tri = tris[t];
+        for (uint32_t v : tri) {
+          if (position_id[v] == to)
+            partner = v;
+        }
+        if (hasPosition(tri, to))
+          continue;
+        glm::vec3 p[3], moved[3];
+        for (int k = 0; k < 3; k++) {
+          p[k] = positions[position_id[tri[k]]];
+          moved[k] = (tri[k] == u ? positions[to] : p[k]);
+        }
+        if (glm::dot(faceNormal(p[0], p[1], p[2]), faceNormal(moved[0], moved[1], moved[2])) <= 0)
+          return false;
+      }
+      if (vertex_tris[u].empty())
+        continue; // unused vertex
+      if (partner == UINT32_MAX)
+        return false;
+      merges.emplace_back(u, partner);
+    }
+    return !merges.empty();
+  };
+
+  std::vector<Level> levels;
+  size_t live_tris = tri_count;
+  double max_cost = 0;
+  size_t next_target = 0;
+  auto snapshot = [&]() {
+    Level level;
+    for (size_t t = 0; t < tri_count; t++) {
+      if (!tri_removed[t])
+        level.indices.insert(level.indices.end(), tris[t].begin(), tris[t].end());
+    }
+    level.error = (float)std::sqrt(max_cost);
+    levels.push_back(std::move(level));
+  };
+
+  while (next_target < target_triangles.size() && !heap.empty()) {
+    Collapse c = heap.top();
+    heap.pop();
+    if (position_removed[c.from] || position_removed[c.to] || stamp[c.from] != c.from_stamp || stamp[c.to] != c.to_stamp)
+      continue;
+    if (!planCollapse(c.from, c.to))
+      continue;
+
+    for (auto [u, v] : merges) {
+      for (uint32_t t : vertex_tris[u]) {
+        if (tri_removed[t])
+          continue;
+        auto &tri = tris[t];
+        if (hasPosition(tri, c.to)) {
+          tri_removed[t] = true;
+          live_tris--;
+          continue;
+        }
+        for (uint32_t &w : tri) {
+          if (w == u)
+            w = v;
+        }
+        vertex_tris[v].push_back(t);
+      }
+      vertex_tris[u].clear();
+    }
+    position_removed[c.from] = true;
+    quadrics[c.to] += quadrics[c.from];
+    max_cost = std::max(max_cost, c.cost);
+
+    // Only collapses touching `to` changed cost
+    stamp[c.to]++;
+    for (uint32_t v : position_vertices[c.to]) {
+      auto &v_tris = vertex_tris[v];
+      v_tris.erase(std::remove_if(v_tris.begin(), v_tris.end(), [&](uint32_t t) { return tri_removed[t]; }), v_tris.end());
+      for (uint32_t t : v_tris) {
+        for (uint32_t w : tris[t]) {
+          if (position_id[w] != c.to) {
+            pushCollapse(c.to, position_id[w]);
+            pushCollapse(position_id[w], c.to);
+          }
+        }
+      }
+    }
+
+    while (next_target < target_triangles.size() && live_tris <= target_triangles[next_target]) {
+      snapshot();
+      next_target++;
+    }
+  }
+  return levels;
+}
+
+} // namespace mesh_simplify
@@ -0,0 +1,194 @@
+// Compares the chunked OBJ parser with the original ifstream/sscanf loader:
+// checks that both produce the same vertices and reports load times.
+// The files are also parsed split into many small chunks, as files above
+// obj::MIN_CHUNK_SIZE are, and a generated OBJ whose relative (negative)
+// indices reach back across chunk boundaries is checked against the values
+// it was generated from.
+//
+// usage: obj_bench [file.obj ...] [--runs N] [--threads N]
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "obj_loader.hpp"
+
+// The loader as it was before obj::parse, kept as the reference
+static MeshData legacyLoadSimpleObj(const std::string &path) {
+  std::ifstream fin(path);
+  assert(fin);
+
+  MeshData data;
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec2> uvs;
+  std::vector<glm::vec3> normals;
+
+  while (fin) {
+    std::string kind;
+    if (!(fin >> kind))
+        break;
+    if (kind == "v") {
+      glm::vec3 pos;
+      fin >> pos.x >> pos.y >> pos.z;
+      positions.push_back(pos);
+    } else if (kind == "vt") {
+      glm::vec2 uv;
+      fin >> uv.x >> uv.y;
+      uvs.push_back(uv);
+    } else if (kind == "f") {
+      for (int i = 0; i < 3; i++) {
+        std::string vert_indices;
+        fin >> vert_indices;
+
+        int pos_idx, uv_idx, norm_idx;
+        int scanned = sscanf(vert_indices.c_str(), "%d/%d/%d", &pos_idx, &uv_idx, &norm_idx);
+        assert(scanned == 3);
+
+        MeshVertex v = {};
+        v.pos = positions[pos_idx - 1];
+        v.tex_coord = uvs[uv_idx - 1];
+        v.normal = normals[norm_idx - 1];
+
+        data.vertices.push_back(v);
+        data.indices.push_back(data.indices.size());
+      }
+    } else if (kind == "vn") {
+      glm::vec3 norm;
+      fin >> norm.x >> norm.y >> norm.z;
+      normals.push_back(norm);
+    } else {
+        std::string line;
+        std::getline(fin, line);
+    }
+  }
+  return data;
+}
+
+static bool sameMesh(const MeshData &a, const MeshData &b) {
+  return a.vertices.size() == b.vertices.size()
+      && a.indices == b.indices
+      && std::memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(MeshVertex)) == 0;
+}
+
+// Many chunks even for small files
+constexpr unsigned SPLIT_THREADS = 8;
+constexpr size_t SPLIT_CHUNK_SIZE = 4096;
+
+/**
+ * A grid of quads written row by row: each row's positions, uvs and normal, then the faces
+ * joining it to the previous row. Odd rows index relatively, so their faces reach back into
+ * the previous row, which a chunk boundary often separates from them; even rows use absolute
+ * indices. Parsed in one chunk and in many, both must match the generated vertices.
+ */
+static bool checkRelativeIndices() {
+  constexpr int COLUMNS = 40, ROWS = 400;
+  std::ostringstream text;
+  text.precision(9); // round-trips floats
+  std::vector<glm::vec3> positions, normals;
+  std::vector<glm::vec2> uvs;
+  MeshData expected;
+  for (int r = 0; r < ROWS; r++) {
+    for (int c = 0; c < COLUMNS; c++) {
+      positions.push_back({c * 0.5f, r * 0.25f, (c ^ r) * 0.125f});
+      uvs.push_back({c / 64.0f, r / 512.0f});
+      text << "v " << positions.back().x << ' ' << positions.back().y << ' ' << positions.back().z << '\n';
+      text << "vt " << uvs.back().x << ' ' << uvs.back().y << '\n';
+    }
+    normals.push_back({0, 1, r / 512.0f});
+    text << "vn " << normals.back().x << ' ' << normals.back().y << ' ' << normals.back().z << '\n';
+    if (r == 0)
+      continue;
+
+    bool relative = (r % 2 == 1);
+    auto corner = [&](int row, int column) {
+      long long vertex = (long long)row * COLUMNS + column, normal = row;
+      if (relative)
+        text << ' ' << vertex - (long long)positions.size() << '/' << vertex - (long long)uvs.size()
+             << '/' << normal - (long long)normals.size();
+      else
+        text << ' ' << vertex + 1 << '/' << vertex + 1 << '/' << normal + 1;
+      MeshVertex v = {};
+      v.pos = positions[vertex];
+      v.tex_coord = uvs[vertex];
+      v.normal = normals[normal];
+      return v;
+    };
+    for (int c = 0; c + 1 < COLUMNS; c++) {
+      text << 'f';
+      MeshVertex quad[4] = {corner(r - 1, c), corner(r - 1, c + 1), corner(r, c + 1), corner(r, c)};
+      text << '\n';
+      // Fanned by the parser into (0, 1, 2) and (0, 2, 3)
+      for (int k : {0, 1, 2, 0, 2, 3}) {
+        expected.vertices.push_back(quad[k]);
+        expected.indices.push_back((uint32_t)expected.indices.size());
+      }
+    }
+  }
+
+  std::string source = text.str();
+  MeshData whole = obj::parse(source.data(), source.data() + source.size(), 1);
+  MeshData split = obj::parse(source.data(), source.data() + source.size(), SPLIT_THREADS, SPLIT_CHUNK_SIZE);
+  bool ok = sameMesh(whole, expected) && sameMesh(split, expected);
+  std::printf("relative indices: %zu bytes in %zu chunks, %zu corners: %s\n", source.size(),
+              std::min<size_t>(source.size() / SPLIT_CHUNK_SIZE, SPLIT_THREADS), expected.vertices.size(),
+              (ok ? "ok" : "FAIL"));
+  return ok;
+}
+
+template <typename TFunc>
+static double bestOf(int runs, TFunc f) {
+  double best = 1e30;
+  for (int i = 0; i < runs; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> paths;
+  int runs = 10;
+  unsigned threads = obj::defaultThreadCount();
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--runs") && i + 1 < argc)
+      runs = std::atoi(argv[++i]);
+    else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc)
+      threads = (unsigned)std::atoi(argv[++i]);
+    else
+      paths.push_back(argv[i]);
+  }
+  if (paths.empty())
+    paths = {"./data/roma_smol.obj", "./data/projectile.obj"};
+
+  int status = checkRelativeIndices() ? 0 : 1;
+  std::printf("%-28s %10s %12s %12s %9s\n", "file", "vertices", "legacy ms", "chunked ms", "speedup");
+  for (const std::string &path : paths) {
+    MeshData reference = legacyLoadSimpleObj(path);
+    MeshData parsed = obj::loadFile(path, threads);
+
+    if (!sameMesh(reference, parsed)) {
+      std::fprintf(stderr, "%s: output differs from the legacy loader\n", path.c_str());
+      status = 1;
+    }
+    MappedFile file(path);
+    MeshData split = obj::parse(file.data(), file.data() + file.size(), SPLIT_THREADS, SPLIT_CHUNK_SIZE);
+    if (!sameMesh(reference, split)) {
+      std::fprintf(stderr, "%s: output differs from the legacy loader when split into %zu byte chunks\n",
+                   path.c_str(), SPLIT_CHUNK_SIZE);
+      status = 1;
+    }
+
+    double legacy = bestOf(runs, [&] { legacyLoadSimpleObj(path); });
+    double chunked = bestOf(runs, [&] { obj::loadFile(path, threads); });
+    std::printf("%-28s %10zu %12.3f %12.3f %8.1fx\n", path.c_str(), parsed.vertices.size(),
+                legacy * 1e3, chunked * 1e3, legacy / chunked);
+  }
+  return status;
+}
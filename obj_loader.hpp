@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mapped_file.hpp"
+#include "mesh_data.hpp"
+
+/**
+ * Wavefront OBJ parser.
+ *
+ * The file is split into line-aligned chunks that are tokenized in parallel.
+ * Each chunk collects its own v/vt/vn lists and triangulated face corners;
+ * a second parallel pass resolves the indices against the global lists
+ * and writes one MeshVertex per face corner, in file order.
+ *
+ * Supported faces: v, v/t, v//n and v/t/n corners, triangles, quads and
+ * n-gons (fanned), positive and negative (relative) indices.
+ * Unknown directives are skipped, out of range indices leave the attribute zeroed.
+ */
+namespace obj {
+
+// Chunks smaller than this are not worth a thread
+constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+struct Corner {
+  // Positive: global 1-based index. Relative (negative in the file): chunk-local 0-based index, may be < 0.
+  int32_t v = 0, t = 0, n = 0;
+  uint8_t relative = 0; // bit 0 - v, bit 1 - t, bit 2 - n
+};
+
+struct Chunk {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec2> uvs;
+  std::vector<glm::vec3> normals;
+  std::vector<Corner> corners; // 3 per triangle
+
+  // Filled in after all chunks are parsed
+  size_t positions_base = 0, uvs_base = 0, normals_base = 0, corners_base = 0;
+};
+
+inline bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char *skipSpaces(const char *p, const char *end) {
+  while (p < end && isSpace(*p))
+    p++;
+  return p;
+}
+
+inline const char *skipLine(const char *p, const char *end) {
+  const char *nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+  return nl ? nl + 1 : end;
+}
+
+inline const char *parseInt(const char *p, const char *end, int32_t &out) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = (*p++ == '-');
+  int64_t value = 0;
+  while (p < end && *p >= '0' && *p <= '9')
+    value = value * 10 + (*p++ - '0');
+  out = (int32_t)(negative ? -value : value);
+  return p;
+}
+
+/**
+ * Decimal float with an optional exponent. Short mantissas (all that OBJ
+ * exporters write) are converted exactly via one double multiply or divide;
+ * anything longer falls back to strtod.
+ */
+inline const char *parseFloat(const char *p, const char *end, float &out) {
+  static constexpr double POW10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  const char *start = p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = (*p++ == '-');
+
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += (mantissa != 0);
+    } else {
+      exponent++;
+    }
+    p++;
+  }
+  if (p < end && *p == '.') {
+    p++;
+    while (p < end && *p >= '0' && *p <= '9') {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += (mantissa != 0);
+        exponent--;
+      }
+      p++;
+    }
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    int32_t e = 0;
+    p = parseInt(p + 1, end, e);
+    exponent += e;
+  }
+
+  if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+    double value = (double)mantissa;
+    value = (exponent < 0 ? value / POW10[-exponent] : value * POW10[exponent]);
+    out = (float)(negative ? -value : value);
+    return p;
+  }
+
+  char buffer[128];
+  size_t length = std::min((size_t)(p - start), sizeof(buffer) - 1);
+  std::memcpy(buffer, start, length);
+  buffer[length] = 0;
+  out = (float)std::strtod(buffer, nullptr);
+  return p;
+}
+
+inline const char *parseCorner(const char *p, const char *end, const Chunk &chunk, Corner &corner) {
+  int32_t idx[3] = {0, 0, 0};
+  size_t local_counts[3] = {chunk.positions.size(), chunk.uvs.size(), chunk.normals.size()};
+  for (int k = 0; k < 3; k++) {
+    if (k > 0) {
+      if (p >= end || *p != '/')
+        break;
+      p++;
+    }
+    if (p < end && (*p == '-' || (*p >= '0' && *p <= '9')))
+      p = parseInt(p, end, idx[k]);
+    if (idx[k] < 0) {
+      idx[k] = (int32_t)local_counts[k] + idx[k];
+      corner.relative |= (uint8_t)(1 << k);
+    }
+  }
+  corner.v = idx[0];
+  corner.t = idx[1];
+  corner.n = idx[2];
+  return p;
+}
+
+inline void parseChunk(const char *p, const char *end, Chunk &chunk) {
+  std::vector<Corner> polygon;
+  while (p < end) {
+    p = skipSpaces(p, end);
+    if (p >= end)
+      break;
+
+    if (p[0] == 'v' && p + 1 < end && isSpace(p[1])) {
+      glm::vec3 pos;
+      p = parseFloat(skipSpaces(p + 1, end), end, pos.x);
+      p = parseFloat(skipSpaces(p, end), end, pos.y);
+      p = parseFloat(skipSpaces(p, end), end, pos.z);
+      chunk.positions.push_back(pos);
+    } else if (p[0] == 'v' && p + 2 < end && p[1] == 't' && isSpace(p[2])) {
+      glm::vec2 uv;
+      p = parseFloat(skipSpaces(p + 2, end), end, uv.x);
+      p = parseFloat(skipSpaces(p, end), end, uv.y);
+      chunk.uvs.push_back(uv);
+    } else if (p[0] == 'v' && p + 2 < end && p[1] == 'n' && isSpace(p[2])) {
+      glm::vec3 norm;
+      p = parseFloat(skipSpaces(p + 2, end), end, norm.x);
+      p = parseFloat(skipSpaces(p, end), end, norm.y);
+      p = parseFloat(skipSpaces(p, end), end, norm.z);
+      chunk.normals.push_back(norm);
+    } else if (p[0] == 'f' && p + 1 < end && isSpace(p[1])) {
+      polygon.clear();
+      p = skipSpaces(p + 1, end);
+      while (p < end && *p != '\n' && *p != '#') {
+        Corner corner;
+        const char *next = parseCorner(p, end, chunk, corner);
+        if (next == p)
+          break; // garbage, drop the rest of the line
+        polygon.push_back(corner);
+        p = skipSpaces(next, end);
+      }
+      for (size_t i = 1; i + 1 < polygon.size(); i++) {
+        chunk.corners.push_back(polygon[0]);
+        chunk.corners.push_back(polygon[i]);
+        chunk.corners.push_back(polygon[i + 1]);
+      }
+    }
+    p = skipLine(p, end);
+  }
+}
+
+template <typename T>
+const T *resolve(const std::vector<T> &all, int32_t idx, bool relative, size_t base) {
+  int64_t absolute = (relative ? (int64_t)base + idx : (int64_t)idx - 1);
+  if (absolute < 0 || absolute >= (int64_t)all.size())
+    return nullptr;
+  return &all[absolute];
+}
+
+template <typename TFunc>
+void runParallel(size_t count, TFunc f) {
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < count; i++)
+    workers.emplace_back(f, i);
+  f(0);
+  for (auto &worker : workers)
+    worker.join();
+}
+
+inline unsigned defaultThreadCount() {
+#ifdef __EMSCRIPTEN__
+  return 1;
+#else
+  return std::max(1u, std::thread::hardware_concurrency());
+#endif
+}
+
+/**
+ * Parses OBJ text in [begin, end) on up to `threads` threads, in chunks of at least
+ * `min_chunk_size` bytes; tests lower it to split small files.
+ */
+inline MeshData parse(const char *begin, const char *end, unsigned threads = defaultThreadCount(),
+                      size_t min_chunk_size = MIN_CHUNK_SIZE) {
+  size_t size = end - begin;
+  size_t chunk_count = std::clamp<size_t>(size / std::max<size_t>(min_chunk_size, 1), 1, std::max(1u, threads));
+
+  std::vector<const char*> bounds{begin};
+  for (size_t i = 1; i < chunk_count; i++) {
+    const char *split = std::max(begin + size * i / chunk_count, bounds.back());
+    bounds.push_back(skipLine(split, end));
+  }
+  bounds.push_back(end);
+
+  std::vector<Chunk> chunks(chunk_count);
+  runParallel(chunk_count, [&](size_t i) {
+    parseChunk(bounds[i], bounds[i + 1], chunks[i]);
+  });
+
+  // Gather the attribute lists; faces only need them resolved, so this is a plain concatenation
+  std::vector<glm::vec3> positions, normals;
+  std::vector<glm::vec2> uvs;
+  size_t corner_count = 0;
+  for (Chunk &chunk : chunks) {
+    chunk.positions_base = positions.size();
+    chunk.uvs_base = uvs.size();
+    chunk.normals_base = normals.size();
+    chunk.corners_base = corner_count;
+    positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+    uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+    normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+    corner_count += chunk.corners.size();
+  }
+
+  MeshData data;
+  data.vertices.resize(corner_count);
+  data.indices.resize(corner_count);
+  runParallel(chunk_count, [&](size_t i) {
+    const Chunk &chunk = chunks[i];
+    for (size_t c = 0; c < chunk.corners.size(); c++) {
+      const Corner &corner = chunk.corners[c];
+      MeshVertex v = {};
+      if (auto pos = resolve(positions, corner.v, corner.relative & 1, chunk.positions_base))
+        v.pos = *pos;
+      if (auto uv = resolve(uvs, corner.t, corner.relative & 2, chunk.uvs_base))
+        v.tex_coord = *uv;
+      if (auto norm = resolve(normals, corner.n, corner.relative & 4, chunk.normals_base))
+        v.normal = *norm;
+      data.vertices[chunk.corners_base + c] = v;
+      data.indices[chunk.corners_base + c] = (uint32_t)(chunk.corners_base + c);
+    }
+  });
+  return data;
+}
+
+inline MeshData loadFile(const std::string &path, unsigned threads = defaultThreadCount()) {
+  MappedFile file(path);
+  if (!file.isOpen()) {
+    std::cerr << "Failed to open " << path << std::endl;
+    return {};
+  }
+  return parse(file.data(), file.data() + file.size(), threads);
+}
+
+} // namespace obj
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * Frame profiler. Every named scope keeps a rolling window of its per-frame totals for
+ * percentiles and histograms, and every timed interval also goes into a bounded trace that
+ * writeChromeTrace dumps as trace-event JSON (chrome://tracing, ui.perfetto.dev).
+ *
+ * CPU scopes are timed here; GPU intervals are measured elsewhere (GpuTimers) and reported
+ * through record() in this clock's time base. GL-free, so the headless tools can use it.
+ */
+class Profiler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Track : uint32_t { cpu = 0, gpu = 1 };
+
+  static constexpr size_t HISTORY = 240; // frames
+  static constexpr size_t TRACE_CAPACITY = 1 << 16; // events
+
+  /**
+   * The `p`-th percentile (0..1) of `values`, the nearest sample below it; 0 if there are none.
+   */
+  template <typename T>
+  [[nodiscard]] static T percentile(std::vector<T> values, double p) {
+    if (values.empty())
+      return 0;
+    size_t k = std::min(values.size() - 1, (size_t)(p * (double)values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+  }
+
+  struct Scope {
+    const char *name;
+    Track track;
+    float history_ms[HISTORY] = {}; // ring, oldest at `next`
+    size_t next = 0;
+    size_t filled = 0;
+    double frame_ms = 0; // accumulated during the current frame
+
+    /**
+     * The `p`-th percentile (0..1) of the frames in the window.
+     */
+    [[nodiscard]] float percentile(float p) const {
+      return Profiler::percentile(std::vector<float>(history_ms, history_ms + filled), p);
+    }
+
+    /**
+     * The window in chronological order, for plotting.
+     */
+    [[nodiscard]] std::vector<float> chronological() const {
+      std::vector<float> result;
+      for (size_t i = 0; i < filled; i++)
+        result.push_back(history_ms[(next + HISTORY - filled + i) % HISTORY]);
+      return result;
+    }
+  };
+
+  /**
+   * Times its own lifetime as one interval of `name`.
+   */
+  class CpuScope {
+   public:
+    CpuScope(Profiler *profiler, const char *name) : profiler_(profiler), name_(name) {
+      if (profiler_)
+        start_ = profiler_->now();
+    }
+
+    CpuScope(const CpuScope&) = delete;
+    CpuScope& operator=(const CpuScope&) = delete;
+
+    ~CpuScope() {
+      if (profiler_)
+        profiler_->record(name_, Track::cpu, start_, profiler_->now());
+    }
+
+   private:
+    Profiler *profiler_;
+    const char *name_;
+    int64_t start_ = 0;
+  };
+
+  Profiler() : epoch_(Clock::now()) {
+  }
+
+  /**
+   * Nanoseconds since the profiler was created.
+   */
+  [[nodiscard]] int64_t now() const {
+    return toNs(Clock::now());
+  }
+
+  [[nodiscard]] int64_t toNs(Clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch_).count();
+  }
+
+  [[nodiscard]] CpuScope cpu(const char *name) {
+    return CpuScope(this, name);
+  }
+
+  /**
+   * Adds the interval [start_ns, end_ns) to the current frame of `name` and to the trace.
+   * `name` must outlive the profiler (a string literal).
+   */
+  void record(const char *name, Track track, int64_t start_ns, int64_t end_ns) {
+    scope(name, track).frame_ms += (double)(end_ns - start_ns) * 1e-6;
+    if (trace_.size() < TRACE_CAPACITY)
+      trace_.push_back({name, track, start_ns, end_ns});
+    else
+      trace_[trace_next_] = {name, track, start_ns, end_ns};
+    trace_next_ = (trace_next_ + 1) % TRACE_CAPACITY;
+  }
+
+  /**
+   * Closes the frame: each scope's total goes into its window, including zero for scopes
+   * that did not run, so the percentiles are per frame.
+   */
+  void endFrame() {
+    for (Scope &s : scopes_) {
+      s.history_ms[s.next] = (float)s.frame_ms;
+      s.next = (s.next + 1) % HISTORY;
+      s.filled = std::min(s.filled + 1, HISTORY);
+      s.frame_ms = 0;
+    }
+  }
+
+  /**
+   * In order of first use.
+   */
+  [[nodiscard]] const std::vector<Scope> &scopes() const {
+    return scopes_;
+  }
+
+  /**
+   * Writes the trace, oldest event first; CPU and GPU are shown as two threads.
+   */
+  bool writeChromeTrace(const std::string &path) const {
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (!file)
+      return false;
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n");
+    std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"GPU\"}}");
+    size_t first = (trace_.size() < TRACE_CAPACITY ? 0 : trace_next_);
+    for (size_t i = 0; i < trace_.size(); i++) {
+      const Event &e = trace_[(first + i) % trace_.size()];
+      std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                   e.name, e.track == Track::gpu ? "gpu" : "cpu", (unsigned)e.track,
+                   (double)e.start_ns * 1e-3, (double)(e.end_ns - e.start_ns) * 1e-3);
+    }
+    std::fprintf(file, "\n]}\n");
+    return std::fclose(file) == 0;
+  }
+
+ private:
+  struct Event {
+    const char *name;
+    Track track;
+    int64_t start_ns, end_ns;
+  };
+
+  Clock::time_point epoch_;
+  std::vector<Scope> scopes_;
+  std::vector<Event> trace_;
+  size_t trace_next_ = 0;
+
+  Scope &scope(const char *name, Track track) {
+    for (Scope &s : scopes_) {
+      if (s.track == track && (s.name == name || std::strcmp(s.name, name) == 0))
+        return s;
+    }
+    scopes_.push_back(Scope{name, track});
+    return scopes_.back();
+  }
+};
@@ -0,0 +1,413 @@
+// Offscreen render benchmark: draws the scene with Graphics::drawScene into a framebuffer
+// object at a chosen resolution, from an invisible window, for a number of frames driven
+// by the scripted bot or an input recording, and reports frame time statistics. Meant for
+// machines without a GPU, under Mesa's software rasterizer, to catch render-side CPU
+// regressions, e.g.
+//
+//   LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe xvfb-run -a ./render_bench --frames 600
+//
+// Each frame is finished (glFinish) before its time is taken, so with a software driver the
+// time includes the rasterization. Captured frames are read back and hashed; with --png they
+// are also written as PNG files. Run from the repository root, like the game, for the assets.
+//
+// usage: render_bench [--frames N] [--warmup N] [--width W] [--height H] [--samples N]
+//                     [--dt SECONDS] [--tick-rate N] [--fire-rate SHOTS_PER_SECOND] [--seed N]
+//                     [--replay FILE] [--capture-every N] [--png PREFIX] [--trace FILE]
+//                     [--egl] [--compact-vertices 0|1] [--instancing 0|1] [--lod 0|1]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include "window.hpp"
+#include "graphics.hpp"
+#include "bot.hpp"
+#include "replay.hpp"
+#include "timestep.hpp"
+#include "blob.hpp"
+
+struct BenchOptions {
+  long long frames = 600;
+  long long warmup = 30; // frames drawn after the assets are resident, not measured
+  int width = 1024;
+  int height = 768;
+  int samples = 0;
+  double dt = 1.0 / 60; // frame time of the scripted run
+  double tick_rate = 60;
+  double fire_rate = 10;
+  int64_t seed = 42;
+  std::string replay; // input recording to draw instead of the scripted run
+  long long capture_every = 0; // 0: no captures
+  std::string png; // capture file prefix, none: checksums only
+  std::string trace;
+  bool egl = false;
+  GraphicsOptions graphics;
+};
+
+static BenchOptions parseOptions(int argc, char **argv) {
+  BenchOptions options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--egl") {
+      options.egl = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+      std::exit(1);
+    }
+    const char *value = argv[++i];
+    if (arg == "--frames")
+      options.frames = std::atoll(value);
+    else if (arg == "--warmup")
+      options.warmup = std::atoll(value);
+    else if (arg == "--width")
+      options.width = std::atoi(value);
+    else if (arg == "--height")
+      options.height = std::atoi(value);
+    else if (arg == "--samples")
+      options.samples = std::atoi(value);
+    else if (arg == "--dt")
+      options.dt = std::atof(value);
+    else if (arg == "--tick-rate")
+      options.tick_rate = std::atof(value);
+    else if (arg == "--fire-rate")
+      options.fire_rate = std::atof(value);
+    else if (arg == "--seed")
+      options.seed = std::atoll(value);
+    else if (arg == "--replay")
+      options.replay = value;
+    else if (arg == "--capture-every")
+      options.capture_every = std::atoll(value);
+    else if (arg == "--png")
+      options.png = value;
+    else if (arg == "--trace")
+      options.trace = value;
+    else if (arg == "--compact-vertices")
+      options.graphics.compact_vertices = std::atoi(value) != 0;
+    else if (arg == "--instancing")
+      options.graphics.instancing = std::atoi(value) != 0;
+    else if (arg == "--lod")
+      options.graphics.lod = std::atoi(value) != 0;
+    else {
+      std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+      std::exit(1);
+    }
+  }
+  if (options.width <= 0 || options.height <= 0 || options.frames <= 0) {
+    std::fprintf(stderr, "--width, --height and --frames must be positive\n");
+    std::exit(1);
+  }
+  if (!options.png.empty() && options.capture_every == 0)
+    options.capture_every = options.frames;
+  return options;
+}
+
+/**
+ * Color and depth renderbuffers drawn into instead of the window. With samples, they are
+ * multisampled like the game's window and resolved every frame into a single-sampled color
+ * buffer, which is what the swap does for the window.
+ */
+class OffscreenTarget {
+ public:
+  OffscreenTarget(int width, int height, int samples) : width_(width), height_(height) {
+    glGenFramebuffers(1, &draw_fbo_);
+    glBindFramebuffer(GL_FRAMEBUFFER, draw_fbo_);
+    color_ = attach(GL_COLOR_ATTACHMENT0, GL_RGBA8, samples);
+    depth_ = attach(GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT24, samples);
+    complete_ = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    if (samples > 0) {
+      glGenFramebuffers(1, &resolve_fbo_);
+      glBindFramebuffer(GL_FRAMEBUFFER, resolve_fbo_);
+      resolved_color_ = attach(GL_COLOR_ATTACHMENT0, GL_RGBA8, 0);
+      complete_ = complete_ && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+    bind();
+  }
+
+  OffscreenTarget(const OffscreenTarget&) = delete;
+  OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+  ~OffscreenTarget() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    uint renderbuffers[] = {color_, depth_, resolved_color_};
+    glDeleteRenderbuffers(3, renderbuffers);
+    uint fbos[] = {draw_fbo_, resolve_fbo_};
+    glDeleteFramebuffers(2, fbos);
+  }
+
+  [[nodiscard]] bool complete() const {
+    return complete_;
+  }
+
+  void bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, draw_fbo_);
+  }
+
+  void resolve() const {
+    if (resolve_fbo_ == 0)
+      return;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, draw_fbo_);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_fbo_);
+    glBlitFramebuffer(0, 0, width_, height_, 0, 0, width_, height_, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    bind();
+  }
+
+  /**
+   * RGBA8 pixels of the last resolved frame, top row first.
+   */
+  void read(std::vector<uint8_t> &pixels) const {
+    size_t row = (size_t)width_ * 4;
+    pixels.resize(row * height_);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, resolve_fbo_ ? resolve_fbo_ : draw_fbo_);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    bind();
+    // GL rows go bottom up
+    for (int y = 0; y < height_ / 2; y++)
+      std::swap_ranges(pixels.begin() + y * row, pixels.begin() + (y + 1) * row,
+                       pixels.begin() + (height_ - 1 - y) * row);
+  }
+
+ private:
+  int width_, height_;
+  uint draw_fbo_ = 0, resolve_fbo_ = 0;
+  uint color_ = 0, depth_ = 0, resolved_color_ = 0;
+  bool complete_ = false;
+
+  uint attach(GLenum attachment, GLenum format, int samples) const {
+    uint renderbuffer;
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    if (samples > 0)
+      glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, format, width_, height_);
+    else
+      glRenderbufferStorage(GL_RENDERBUFFER, format, width_, height_);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, renderbuffer);
+    return renderbuffer;
+  }
+};
+
+/**
+ * What to draw each frame: the scripted bot playing like headless does, or a recording
+ * stepped like the game's --replay. Mirrors the game loop's simulation and interpolation.
+ */
+class SceneDriver {
+ public:
+  explicit SceneDriver(const BenchOptions &options)
+        : options_(options)
+        , bot_(options.fire_rate)
+        , scripted_scene_(&bot_, options.seed)
+        , timestep_(options.tick_rate, 16) {
+    if (!options.replay.empty())
+      player_.emplace(options.replay);
+  }
+
+  [[nodiscard]] bool valid() const {
+    return !player_ || player_->valid();
+  }
+
+  [[nodiscard]] Scene &scene() {
+    return player_ ? player_->scene() : scripted_scene_;
+  }
+
+  /**
+   * Simulates the next frame; false when the recording has ended.
+   */
+  bool step() {
+    if (player_) {
+      if (!player_->step())
+        return false;
+      game_time_ = player_->gameTime();
+      return true;
+    }
+    int shots = bot_.advance(options_.dt);
+    for (int i = 0; i < shots; i++)
+      scripted_scene_.spawnProjectile();
+    int ticks = timestep_.advance(options_.dt);
+    for (int i = 0; i < ticks; i++) {
+      game_time_ += timestep_.tickDuration();
+      scripted_scene_.update(timestep_.tickDuration());
+    }
+    return true;
+  }
+
+  [[nodiscard]] float alpha() const {
+    return (float)ticked().alpha();
+  }
+
+  [[nodiscard]] double renderTime() const {
+    return game_time_ - (1 - ticked().alpha()) * ticked().tickDuration();
+  }
+
+ private:
+  const BenchOptions &options_;
+  ScriptedBot bot_;
+  Scene scripted_scene_;
+  FixedTimestep timestep_;
+  std::optional<replay::Player> player_;
+  double game_time_ = 0;
+
+  [[nodiscard]] const FixedTimestep &ticked() const {
+    return player_ ? player_->timestep() : timestep_;
+  }
+};
+
+static void printTimes(const char *name, const std::vector<double> &ms) {
+  double sum = 0;
+  for (double t : ms)
+    sum += t;
+  std::printf("%-10s %10.3f %10.3f %10.3f %10.3f %10.3f\n", name, sum / ms.size(), Profiler::percentile(ms, 0.5),
+              Profiler::percentile(ms, 0.95), Profiler::percentile(ms, 0.99), *std::max_element(ms.begin(), ms.end()));
+}
+
+static bool writePng(const std::string &prefix, long long frame, int width, int height, const std::vector<uint8_t> &pixels) {
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), "%06lld.png", frame);
+  std::string path = prefix + suffix;
+  if (!stbi_write_png(path.c_str(), width, height, 4, pixels.data(), width * 4)) {
+    std::fprintf(stderr, "cannot write %s\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options = parseOptions(argc, argv);
+
+  WindowOptions window_options;
+  window_options.width = options.width;
+  window_options.height = options.height;
+  window_options.samples = 0; // the offscreen target has its own
+  window_options.visible = false;
+  window_options.egl = options.egl;
+  window_options.wait_on_error = false;
+  window_options.title = "render_bench";
+  GLFWwindow *window = initGlewGLFW(window_options);
+  std::printf("renderer:       %s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+  int failures = 0;
+  {
+    SceneDriver driver(options);
+    if (!driver.valid()) {
+      std::fprintf(stderr, "cannot read recording %s\n", options.replay.c_str());
+      return 1;
+    }
+
+    OffscreenTarget target(options.width, options.height, options.samples);
+    if (!target.complete()) {
+      std::fprintf(stderr, "offscreen framebuffer incomplete\n");
+      return 1;
+    }
+
+    Graphics graphics(options.graphics);
+    graphics.window = window;
+    graphics.resize(options.width, options.height);
+    graphics.prepare();
+    Scene &scene = driver.scene();
+    scene.pool = &graphics.workers;
+
+    auto drawFrame = [&]() {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      graphics.drawScene(driver.renderTime(), scene, driver.alpha());
+      target.resolve();
+    };
+
+    // Loading runs in the background: draw the first state until everything is resident,
+    // then a few more frames for the driver to compile and upload what the first draws use
+    auto load_start = std::chrono::steady_clock::now();
+    long long load_frames = 0;
+    while (!graphics.assets.done()) {
+      drawFrame();
+      glFinish();
+      graphics.profiler.endFrame();
+      load_frames++;
+    }
+    for (long long i = 0; i < options.warmup; i++) {
+      drawFrame();
+      glFinish();
+      graphics.profiler.endFrame();
+    }
+    std::printf("assets:         resident after %.1f ms, %lld frames\n",
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count(),
+                load_frames);
+
+    scene.profiler = &graphics.profiler;
+    std::vector<double> submit_ms, frame_ms;
+    std::vector<uint8_t> pixels;
+    double draw_calls = 0, triangles = 0;
+    uint64_t digest = 0;
+    long long frame = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (; frame < options.frames; frame++) {
+      if (!driver.step())
+        break;
+
+      auto frame_start = std::chrono::steady_clock::now();
+      drawFrame();
+      auto submitted = std::chrono::steady_clock::now();
+      glFinish();
+      auto finished = std::chrono::steady_clock::now();
+      graphics.profiler.endFrame();
+
+      submit_ms.push_back(std::chrono::duration<double, std::milli>(submitted - frame_start).count());
+      frame_ms.push_back(std::chrono::duration<double, std::milli>(finished - frame_start).count());
+      draw_calls += graphics.draw_calls;
+      triangles += graphics.triangles;
+
+      if (options.capture_every > 0 && (frame + 1) % options.capture_every == 0) {
+        target.read(pixels);
+        uint64_t checksum = hashBytes(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+        digest = (digest ^ checksum) * 0x100000001B3ull;
+        std::printf("frame %6lld:   checksum %016llx\n", frame + 1, (unsigned long long)checksum);
+        if (!options.png.empty() && !writePng(options.png, frame + 1, options.width, options.height, pixels))
+          failures++;
+      }
+    }
+    double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (frame == 0) {
+      std::fprintf(stderr, "no frames drawn\n");
+      return 1;
+    }
+    std::printf("frames:         %lld at %dx%d%s, %.3f s, %.1f frames/sec\n", frame, options.width, options.height,
+                (options.samples > 0 ? (", " + std::to_string(options.samples) + "x MSAA").c_str() : ""),
+                wall_seconds, frame / wall_seconds);
+    std::printf("per frame:      %.1f draw calls, %.0f entity triangles\n", draw_calls / frame, triangles / frame);
+    std::printf("final:          %zu enemies, %zu projectiles, %zu dying\n",
+                scene.enemies.size(), scene.projectiles.size(), scene.dying_objects.size());
+    if (options.capture_every > 0)
+      std::printf("capture digest: %016llx\n", (unsigned long long)digest);
+
+    std::printf("\n%-10s %10s %10s %10s %10s %10s\n", "ms", "mean", "p50", "p95", "p99", "max");
+    printTimes("submit", submit_ms);
+    printTimes("frame", frame_ms);
+
+    std::printf("\n%-18s %12s %12s  (last %zu frames)\n", "scope", "p50 us", "p99 us",
+                std::min(Profiler::HISTORY, (size_t)frame));
+    for (const Profiler::Scope &scope : graphics.profiler.scopes())
+      std::printf("%-18s %12.2f %12.2f%s\n", scope.name, scope.percentile(0.5f) * 1e3, scope.percentile(0.99f) * 1e3,
+                  (scope.track == Profiler::Track::gpu ? "  gpu" : ""));
+    if (!options.trace.empty() && !graphics.profiler.writeChromeTrace(options.trace)) {
+      std::fprintf(stderr, "cannot write %s\n", options.trace.c_str());
+      failures++;
+    }
+
+    for (GLenum err; (err = glGetError()) != GL_NO_ERROR; failures++)
+      std::fprintf(stderr, "gl error %x\n", err);
+  } // GL objects go before the context
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return failures == 0 ? 0 : 1;
+}
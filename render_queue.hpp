@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * Draw commands ordered by a 64-bit sort key before submission, so that draws sharing GL
+ * state end up next to each other and the submitter can skip redundant binds.
+ *
+ * Commands are recorded into buckets, one per recording task, so several threads can record
+ * at once without locking as long as each bucket has a single writer. sort() then orders all
+ * of them with an LSD radix sort on the key, stable, skipping key bytes every command shares.
+ *
+ * Per frame: reset(buckets), bucket(i).push(key, payload) from any thread, sort(), submit(f).
+ */
+template <typename TPayload>
+class RenderQueue {
+ public:
+  class Bucket {
+   public:
+    void push(uint64_t key, const TPayload &payload) {
+      keys_.push_back(key);
+      payloads_.push_back(payload);
+    }
+
+    [[nodiscard]] size_t size() const {
+      return keys_.size();
+    }
+
+   private:
+    friend class RenderQueue;
+    std::vector<uint64_t> keys_;
+    std::vector<TPayload> payloads_;
+  };
+
+  /**
+   * Empties the queue and makes `bucket_count` buckets available; capacity is kept.
+   */
+  void reset(size_t bucket_count) {
+    if (buckets_.size() < bucket_count)
+      buckets_.resize(bucket_count);
+    for (Bucket &bucket : buckets_) {
+      bucket.keys_.clear();
+      bucket.payloads_.clear();
+    }
+    bucket_count_ = bucket_count;
+    sorted_.clear();
+  }
+
+  [[nodiscard]] Bucket &bucket(size_t i) {
+    return buckets_[i];
+  }
+
+  [[nodiscard]] size_t size() const {
+    return sorted_.size();
+  }
+
+  void sort() {
+    sorted_.clear();
+    for (uint32_t b = 0; b < bucket_count_; b++) {
+      for (uint32_t i = 0; i < buckets_[b].size(); i++)
+        sorted_.push_back({buckets_[b].keys_[i], b, i});
+    }
+    scratch_.resize(sorted_.size());
+
+    for (int shift = 0; shift < 64; shift += 8) {
+      size_t counts[256] = {};
+      for (const Entry &e : sorted_)
+        counts[(e.key >> shift) & 0xFF]++;
+      if (sorted_.empty() || counts[(sorted_[0].key >> shift) & 0xFF] == sorted_.size())
+        continue; // every key has this byte
+      size_t offset = 0;
+      for (size_t &count : counts) {
+        size_t c = count;
+        count = offset;
+        offset += c;
+      }
+      for (const Entry &e : sorted_)
+        scratch_[counts[(e.key >> shift) & 0xFF]++] = e;
+      sorted_.swap(scratch_);
+    }
+  }
+
+  /**
+   * Calls f(key, payload) for every command in key order; sort() first.
+   */
+  template <typename TFunc>
+  void submit(TFunc &&f) const {
+    for (const Entry &e : sorted_)
+      f(e.key, buckets_[e.bucket].payloads_[e.index]);
+  }
+
+ private:
+  struct Entry {
+    uint64_t key;
+    uint32_t bucket;
+    uint32_t index;
+  };
+
+  std::vector<Bucket> buckets_;
+  size_t bucket_count_ = 0;
+  std::vector<Entry> sorted_, scratch_;
+};
+
+/**
+ * Sort key layout, most significant first:
+ * pass (4 bits) | program (4) | texture (8) | mesh (8) | variant (8, e.g. level of detail) | depth (32)
+ * Depth is the float bit pattern of a non-negative distance, which orders like the float:
+ * within one state, nearer draws go first and help early depth rejection.
+ */
+namespace sort_key {
+
+inline uint64_t make(uint32_t pass, uint32_t program, uint32_t texture, uint32_t mesh, uint32_t variant, float depth) {
+  uint32_t depth_bits;
+  depth = (depth > 0 ? depth : 0.0f);
+  std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+  return (uint64_t)(pass & 0xF) << 60 | (uint64_t)(program & 0xF) << 56 | (uint64_t)(texture & 0xFF) << 48
+       | (uint64_t)(mesh & 0xFF) << 40 | (uint64_t)(variant & 0xFF) << 32 | depth_bits;
+}
+
+inline uint32_t pass(uint64_t key) { return (uint32_t)(key >> 60) & 0xF; }
+inline uint32_t program(uint64_t key) { return (uint32_t)(key >> 56) & 0xF; }
+inline uint32_t texture(uint64_t key) { return (uint32_t)(key >> 48) & 0xFF; }
+inline uint32_t mesh(uint64_t key) { return (uint32_t)(key >> 40) & 0xFF; }
+inline uint32_t variant(uint64_t key) { return (uint32_t)(key >> 32) & 0xFF; }
+
+} // namespace sort_key
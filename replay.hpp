@@ -0,0 +1,339 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+
+#include "controls.hpp"
+#include "mapped_file.hpp"
+#include "timestep.hpp"
+#include "world.hpp"
+
+/**
+ * Input recordings: everything that decides how the simulation goes, frame by frame, so a
+ * run can be replayed exactly - as fast as possible, headless or rendered - and two builds
+ * compared on the same workload.
+ *
+ * A scene depends on its seed and config, on the controls it polls every tick, on the
+ * projectiles fired between frames and on how many ticks each frame runs, which follows
+ * from the frame time and the time speed. Controls only change between frames (window
+ * events are processed after the swap), so one sample per frame is enough.
+ *
+ * File: Header, then one record per frame: the key bits, a byte saying which of the
+ * optional fields follow, the frame time, then the cursor, clicks, time speed and state
+ * hash, each only if it changed or is due. An idle frame takes 10 bytes.
+ */
+namespace replay {
+
+constexpr char MAGIC[4] = {'R', 'P', 'L', 'Y'};
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t DEFAULT_HASH_INTERVAL = 60; // frames
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  int64_t seed;
+  double tick_rate;
+  int32_t max_ticks_per_frame;
+  uint32_t max_enemies;
+  double spawn_delay;
+};
+
+/**
+ * What a frame consumed, and the state it left the scene in if a hash is due.
+ */
+struct Frame {
+  double frame_time = 0;
+  double time_speed = 1;
+  uint32_t clicks = 0; // projectiles fired before the frame's ticks
+  PlayerControls controls;
+  std::optional<uint64_t> state_hash;
+};
+
+enum Keys : uint8_t {
+  KEY_FORWARD = 1 << 0,
+  KEY_BACKWARD = 1 << 1,
+  KEY_LEFT = 1 << 2,
+  KEY_RIGHT = 1 << 3,
+  KEY_SLOW = 1 << 4,
+};
+
+enum Fields : uint8_t {
+  FIELD_CURSOR = 1 << 0,
+  FIELD_CLICKS = 1 << 1,
+  FIELD_TIME_SPEED = 1 << 2,
+  FIELD_STATE_HASH = 1 << 3,
+};
+
+inline Header makeHeader(int64_t seed, double tick_rate, int max_ticks_per_frame, const SceneConfig &config) {
+  Header header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.seed = seed;
+  header.tick_rate = tick_rate;
+  header.max_ticks_per_frame = max_ticks_per_frame;
+  header.max_enemies = (uint32_t)config.max_enemies;
+  header.spawn_delay = config.spawn_delay;
+  return header;
+}
+
+inline SceneConfig sceneConfig(const Header &header) {
+  SceneConfig config;
+  config.max_enemies = header.max_enemies;
+  config.spawn_delay = header.spawn_delay;
+  return config;
+}
+
+class Recorder {
+ public:
+  Recorder(const std::string &path, const Header &header, uint32_t hash_interval = DEFAULT_HASH_INTERVAL)
+        : out_(path, std::ios::binary | std::ios::trunc)
+        , hash_interval_(hash_interval) {
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+
+  [[nodiscard]] bool good() const {
+    return (bool)out_;
+  }
+
+  [[nodiscard]] uint64_t frames() const {
+    return frames_;
+  }
+
+  /**
+   * Whether the frame about to be written should carry the state hash.
+   */
+  [[nodiscard]] bool hashDue() const {
+    return hash_interval_ > 0 && (frames_ + 1) % hash_interval_ == 0;
+  }
+
+  void write(const Frame &frame) {
+    uint8_t keys = (frame.controls.forward ? KEY_FORWARD : 0) | (frame.controls.backward ? KEY_BACKWARD : 0)
+        | (frame.controls.left ? KEY_LEFT : 0) | (frame.controls.right ? KEY_RIGHT : 0)
+        | (frame.controls.slow ? KEY_SLOW : 0);
+    uint8_t fields = (frame.controls.cursor != last_.controls.cursor ? FIELD_CURSOR : 0)
+        | (frame.clicks ? FIELD_CLICKS : 0)
+        | (frame.time_speed != last_.time_speed ? FIELD_TIME_SPEED : 0)
+        | (frame.state_hash ? FIELD_STATE_HASH : 0);
+    put(keys);
+    put(fields);
+    put(frame.frame_time);
+    // The cursor is absolute: summing deltas on replay would not round the same way
+    if (fields & FIELD_CURSOR)
+      put(frame.controls.cursor);
+    if (fields & FIELD_CLICKS)
+      put(frame.clicks);
+    if (fields & FIELD_TIME_SPEED)
+      put(frame.time_speed);
+    if (fields & FIELD_STATE_HASH)
+      put(*frame.state_hash);
+    last_ = frame;
+    frames_++;
+  }
+
+ private:
+  std::ofstream out_;
+  uint32_t hash_interval_;
+  uint64_t frames_ = 0;
+  Frame last_;
+
+  template <typename T>
+  void put(const T &value) {
+    out_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+};
+
+class Reader {
+ public:
+  explicit Reader(const std::string &path) : file_(path) {
+    valid_ = file_.isOpen() && file_.size() >= sizeof(Header);
+    if (valid_) {
+      std::memcpy(&header_, file_.data(), sizeof(header_));
+      valid_ = std::memcmp(header_.magic, MAGIC, sizeof(MAGIC)) == 0 && header_.version == VERSION;
+    }
+    offset_ = sizeof(Header);
+  }
+
+  [[nodiscard]] bool valid() const {
+    return valid_;
+  }
+
+  [[nodiscard]] const Header &header() const {
+    return header_;
+  }
+
+  /**
+   * Reads the next frame; false at the end of the recording or on a truncated record.
+   */
+  bool next(Frame &frame) {
+    uint8_t keys, fields;
+    if (!valid_ || !get(keys) || !get(fields))
+      return false;
+    frame = last_;
+    frame.clicks = 0;
+    frame.state_hash.reset();
+    frame.controls.forward = keys & KEY_FORWARD;
+    frame.controls.backward = keys & KEY_BACKWARD;
+    frame.controls.left = keys & KEY_LEFT;
+    frame.controls.right = keys & KEY_RIGHT;
+    frame.controls.slow = keys & KEY_SLOW;
+    bool ok = get(frame.frame_time);
+    if (ok && (fields & FIELD_CURSOR))
+      ok = get(frame.controls.cursor);
+    if (ok && (fields & FIELD_CLICKS))
+      ok = get(frame.clicks);
+    if (ok && (fields & FIELD_TIME_SPEED))
+      ok = get(frame.time_speed);
+    if (ok && (fields & FIELD_STATE_HASH)) {
+      uint64_t hash = 0;
+      ok = get(hash);
+      frame.state_hash = hash;
+    }
+    if (!ok)
+      return false;
+    last_ = frame;
+    return true;
+  }
+
+ private:
+  MappedFile file_;
+  Header header_ = {};
+  bool valid_ = false;
+  size_t offset_ = 0;
+  Frame last_;
+
+  template <typename T>
+  bool get(T &value) {
+    if (offset_ + sizeof(value) > file_.size())
+      return false;
+    std::memcpy(&value, file_.data() + offset_, sizeof(value));
+    offset_ += sizeof(value);
+    return true;
+  }
+};
+
+/**
+ * Hands the scene the controls of the frame being replayed.
+ */
+class ReplayInput : public InputSource {
+ public:
+  PlayerControls controls;
+
+  PlayerControls poll() override {
+    return controls;
+  }
+};
+
+/**
+ * Replays a recording into a scene built from its header, checking the state hashes.
+ */
+class Player {
+ public:
+  explicit Player(const std::string &path)
+        : reader_(path)
+        , scene_(&input_, reader_.header().seed, sceneConfig(reader_.header()))
+        , timestep_(reader_.valid() ? reader_.header().tick_rate : 60,
+                    reader_.valid() ? reader_.header().max_ticks_per_frame : 1) {
+  }
+
+  [[nodiscard]] bool valid() const {
+    return reader_.valid();
+  }
+
+  [[nodiscard]] Scene &scene() {
+    return scene_;
+  }
+
+  [[nodiscard]] const FixedTimestep &timestep() const {
+    return timestep_;
+  }
+
+  [[nodiscard]] double gameTime() const {
+    return game_time_;
+  }
+
+  [[nodiscard]] const Frame &frame() const {
+    return frame_;
+  }
+
+  [[nodiscard]] uint64_t frames() const {
+    return frames_;
+  }
+
+  [[nodiscard]] uint64_t ticks() const {
+    return ticks_;
+  }
+
+  [[nodiscard]] uint64_t hashesChecked() const {
+    return hashes_checked_;
+  }
+
+  [[nodiscard]] uint64_t mismatches() const {
+    return mismatches_;
+  }
+
+  /**
+   * Frame of the first state hash mismatch, if any.
+   */
+  [[nodiscard]] std::optional<uint64_t> firstMismatch() const {
+    return first_mismatch_;
+  }
+
+  /**
+   * Runs the next recorded frame's simulation the way the game loop does; false at the end.
+   */
+  bool step() {
+    if (!reader_.next(frame_))
+      return false;
+    input_.controls = frame_.controls;
+    for (uint32_t i = 0; i < frame_.clicks; i++)
+      scene_.spawnProjectile();
+    int ticks = timestep_.advance(frame_.frame_time * frame_.time_speed);
+    for (int i = 0; i < ticks; i++) {
+      game_time_ += timestep_.tickDuration();
+      scene_.update(timestep_.tickDuration());
+    }
+    ticks_ += ticks;
+    frames_++;
+
+    if (frame_.state_hash) {
+      hashes_checked_++;
+      if (scene_.stateHash() != *frame_.state_hash) {
+        mismatches_++;
+        if (!first_mismatch_)
+          first_mismatch_ = frames_;
+      }
+    }
+    return true;
+  }
+
+ private:
+  Reader reader_;
+  ReplayInput input_;
+  Scene scene_;
+  FixedTimestep timestep_;
+  Frame frame_;
+  double game_time_ = 0;
+  uint64_t frames_ = 0;
+  uint64_t ticks_ = 0;
+  uint64_t hashes_checked_ = 0;
+  uint64_t mismatches_ = 0;
+  std::optional<uint64_t> first_mismatch_;
+};
+
+inline void printReport(const Player &player, double wall_seconds) {
+  std::printf("Replayed %llu frames, %llu ticks (%.1f s simulated) in %.3f s, %.1f frames/sec\n",
+              (unsigned long long)player.frames(), (unsigned long long)player.ticks(), player.gameTime(),
+              wall_seconds, player.frames() / wall_seconds);
+  if (player.mismatches())
+    std::printf("State hash mismatch in %llu of %llu checks, first at frame %llu\n",
+                (unsigned long long)player.mismatches(), (unsigned long long)player.hashesChecked(),
+                (unsigned long long)*player.firstMismatch());
+  else
+    std::printf("State hashes match (%llu checks)\n", (unsigned long long)player.hashesChecked());
+}
+
+} // namespace replay
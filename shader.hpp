@@ -5,8 +5,12 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <unordered_map>
 #include <unistd.h>
 
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
 inline std::string readfile(const std::string &path) {
   std::ifstream fin(path);
   fin.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -15,10 +19,36 @@ inline std::string readfile(const std::string &path) {
   return contents.str();
 }
 
-inline uint createShader(std::string path, uint shader_type) {
+/**
+ * Replaces `#include "file"` lines with the file contents, relative to the including file.
+ * One level deep, which is all the shared blocks need.
+ */
+inline std::string expandIncludes(const std::string &src, const std::string &path) {
+  std::string dir = path.substr(0, path.find_last_of('/') + 1);
+  std::istringstream lines(src);
+  std::string result, line;
+  while (std::getline(lines, line)) {
+    size_t open = line.find('"');
+    if (line.compare(0, 8, "#include") == 0 && open != std::string::npos)
+      result += readfile(dir + line.substr(open + 1, line.find('"', open + 1) - open - 1));
+    else
+      result += line;
+    result += '\n';
+  }
+  return result;
+}
+
+/**
+ * `defines` (e.g. "#define FOO\n") are inserted right after the #version line.
+ */
+inline uint createShader(std::string path, uint shader_type, const std::string &defines = "") {
   uint shader = glCreateShader(shader_type);
 
-  std::string src = readfile(path);
+  std::string src = expandIncludes(readfile(path), path);
+  if (!defines.empty()) {
+    size_t version_end = (src.compare(0, 8, "#version") == 0 ? src.find('\n') + 1 : 0);
+    src.insert(version_end, defines);
+  }
   const char *src_cstr = src.c_str();
   glShaderSource(shader, 1, &src_cstr, nullptr);
   glCompileShader(shader);
@@ -34,16 +64,21 @@ inline uint createShader(std::string path, uint shader_type) {
   return shader;
 }
 
-inline uint createShaderProgram(std::string vertexPath, std::string fragmentPath, std::string geometryPath="") {
-  uint vertexShader = createShader(vertexPath, GL_VERTEX_SHADER);
-  uint fragmentShader = createShader(fragmentPath, GL_FRAGMENT_SHADER);
-  uint geometryShader = (!geometryPath.empty() ? createShader(geometryPath, GL_GEOMETRY_SHADER) : 0);
+inline uint createShaderProgram(std::string vertexPath, std::string fragmentPath, std::string geometryPath="",
+                                const std::string &defines = "") {
+  uint vertexShader = createShader(vertexPath, GL_VERTEX_SHADER, defines);
+  uint fragmentShader = createShader(fragmentPath, GL_FRAGMENT_SHADER, defines);
+  uint geometryShader = (!geometryPath.empty() ? createShader(geometryPath, GL_GEOMETRY_SHADER, defines) : 0);
 
   uint shaderProgram = glCreateProgram();
   glAttachShader(shaderProgram, vertexShader);
   glAttachShader(shaderProgram, fragmentShader);
   if (!geometryPath.empty())
     glAttachShader(shaderProgram, geometryShader);
+  // Mesh attribute locations (see VertexLayout); GLSL 100 shaders have no layout qualifiers
+  glBindAttribLocation(shaderProgram, 0, "pos_model");
+  glBindAttribLocation(shaderProgram, 2, "tex_coord_in");
+  glBindAttribLocation(shaderProgram, 3, "normal_model");
   glLinkProgram(shaderProgram);
   {
     int success = 0;
@@ -62,3 +97,146 @@ inline uint createShaderProgram(std::string vertexPath, std::string fragmentPath
 
   return shaderProgram;
 }
+
+
+inline void setUniform(int location, float value) { glUniform1f(location, value); }
+inline void setUniform(int location, int value) { glUniform1i(location, value); }
+inline void setUniform(int location, const glm::vec3 &value) { glUniform3fv(location, 1, glm::value_ptr(value)); }
+inline void setUniform(int location, const glm::vec4 &value) { glUniform4fv(location, 1, glm::value_ptr(value)); }
+inline void setUniform(int location, const glm::mat4 &value) {
+  glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+/**
+ * A reflected uniform location. Setting a uniform the program does not have
+ * (optimized out, or living in a uniform block) is a no-op.
+ */
+template <typename T>
+class Uniform {
+ public:
+  Uniform() = default;
+
+  explicit Uniform(int location) : location_(location) {
+  }
+
+  void set(const T &value) const {
+    if (location_ >= 0)
+      setUniform(location_, value);
+  }
+
+  explicit operator bool() const {
+    return location_ >= 0;
+  }
+
+ private:
+  int location_ = -1;
+};
+
+/**
+ * GL types a Uniform<T> may be bound to.
+ */
+template <typename T> bool uniformTypeMatches(GLenum type);
+template <> inline bool uniformTypeMatches<float>(GLenum type) { return type == GL_FLOAT; }
+template <> inline bool uniformTypeMatches<int>(GLenum type) {
+  return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_CUBE
+      || type == GL_SAMPLER_BUFFER || type == GL_UNSIGNED_INT_SAMPLER_BUFFER;
+}
+template <> inline bool uniformTypeMatches<glm::vec3>(GLenum type) { return type == GL_FLOAT_VEC3; }
+template <> inline bool uniformTypeMatches<glm::vec4>(GLenum type) { return type == GL_FLOAT_VEC4; }
+template <> inline bool uniformTypeMatches<glm::mat4>(GLenum type) { return type == GL_FLOAT_MAT4; }
+
+/**
+ * A linked program with its active uniforms reflected once, at link time.
+ * An empty ShaderProgram (id 0) stands for a program the platform can't have.
+ */
+class ShaderProgram {
+ public:
+  ShaderProgram() = default;
+
+  ShaderProgram(const std::string &vertexPath, const std::string &fragmentPath,
+                const std::string &geometryPath = "", const std::string &defines = "")
+      : id_(createShaderProgram(vertexPath, fragmentPath, geometryPath, defines)) {
+    int count = 0;
+    glGetProgramiv(id_, GL_ACTIVE_UNIFORMS, &count);
+    for (int i = 0; i < count; i++) {
+      char name[256];
+      int size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(id_, (uint)i, sizeof(name), nullptr, &size, &type, name);
+      int location = glGetUniformLocation(id_, name);
+      if (location < 0)
+        continue; // uniform block member
+
+      std::string key = name;
+      if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0)
+        key.resize(key.size() - 3);
+      uniforms_[key] = UniformInfo{location, type};
+    }
+  }
+
+  ShaderProgram(const ShaderProgram&) = delete;
+  ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+  ShaderProgram(ShaderProgram &&other) noexcept : id_(other.id_), uniforms_(std::move(other.uniforms_)) {
+    other.id_ = 0;
+  }
+
+  ~ShaderProgram() {
+    if (id_ != 0)
+      glDeleteProgram(id_);
+  }
+
+  [[nodiscard]] uint id() const {
+    return id_;
+  }
+
+  [[nodiscard]] bool valid() const {
+    return id_ != 0;
+  }
+
+  void use() const {
+    glUseProgram(id_);
+  }
+
+  /**
+   * Handle for `name`; an empty one if the program has no such uniform or its type differs.
+   */
+  template <typename T>
+  [[nodiscard]] Uniform<T> uniform(const std::string &name) const {
+    auto it = uniforms_.find(name);
+    if (it == uniforms_.end())
+      return Uniform<T>();
+    if (!uniformTypeMatches<T>(it->second.type)) {
+      std::cerr << "Uniform " << name << " has an unexpected type" << std::endl;
+      return Uniform<T>();
+    }
+    return Uniform<T>(it->second.location);
+  }
+
+  /**
+   * Attaches the uniform block `name` to a buffer binding point. Returns false if there is no such block,
+   * always in WebGL 1, which has no uniform blocks.
+   */
+  bool bindBlock(const std::string &name, uint binding) const {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    if (id_ == 0)
+      return false;
+    uint index = glGetUniformBlockIndex(id_, name.c_str());
+    if (index == GL_INVALID_INDEX)
+      return false;
+    glUniformBlockBinding(id_, index, binding);
+    return true;
+#endif
+  }
+
+ private:
+  struct UniformInfo {
+    int location;
+    GLenum type;
+  };
+
+  uint id_ = 0;
+  std::unordered_map<std::string, UniformInfo> uniforms_;
+};
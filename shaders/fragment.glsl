@@ -1,36 +1,58 @@
 #version 330 core
 
-#define MAX_NUM_OF_LIGHTS 10
+#include "frame.glsl"
 
-in GS_OUT {
+in VS_OUT {
   vec2 tex_coord;
-  vec3 to_camera, normal;
-  vec3 to_light_array[MAX_NUM_OF_LIGHTS];
+  vec3 pos_camspace, normal;
 };
 
 uniform sampler2D tex;
 uniform float ambientK;
-uniform int number_of_lights;
+
+// Clustered lights, see LightClusters
+uniform samplerBuffer lights;        // xyz - camera space position, w - radius
+uniform usamplerBuffer light_grid;   // x - first entry in light_indices, y - count; per cluster
+uniform usamplerBuffer light_indices;
 
 out vec4 color;
 
+int clusterIndex() {
+  ivec2 tile = ivec2(gl_FragCoord.xy / cluster_params.xy * vec2(CLUSTERS_X, CLUSTERS_Y));
+  tile = clamp(tile, ivec2(0), ivec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+  float depth = max(-pos_camspace.z, cluster_params.z);
+  int slice = int(log(depth / cluster_params.z) / log(cluster_params.w / cluster_params.z) * CLUSTERS_Z);
+  slice = clamp(slice, 0, CLUSTERS_Z - 1);
+  return (slice * CLUSTERS_Y + tile.y) * CLUSTERS_X + tile.x;
+}
+
 void main()
 {
   vec2 tex_coord_wrapped = tex_coord - floor(tex_coord); // webgl can't handle GL_REPEAT (non 2^p textures), emulate it manually
   vec3 reflectance = texture(tex, tex_coord_wrapped).xyz;
   vec3 lightColor = vec3(0.9, 0.9, 0.9);
 
+  vec3 to_camera = -pos_camspace;
+  vec3 n = normalize(normal);
+
   float totalLight = 0;
-  for (int i = 0; i < number_of_lights; ++i) {
-    float lightPower = min(1 / dot(to_light_array[i], to_light_array[i]), 1);
+  uvec2 cluster = texelFetch(light_grid, clusterIndex()).xy;
+  for (uint i = 0u; i < cluster.y; ++i) {
+    vec4 light = texelFetch(lights, int(texelFetch(light_indices, int(cluster.x + i)).x));
+    vec3 to_light = light.xyz - pos_camspace;
+    float distance2 = dot(to_light, to_light);
+
+    // Fades to zero at the radius the light was binned with
+    float window = clamp(1 - distance2 / (light.w * light.w), 0, 1);
+    float lightPower = min(1 / distance2, 1) * window * window;
+
+    float diffuseK = max(0, dot(normalize(to_light), n));
+    float specularK = max(0, dot(normalize(to_camera), reflect(-normalize(to_light), n)));
 
-    float diffuseK = max(0, dot(normalize(to_light_array[i]), normalize(normal)));
-    float specularK = max(0, dot(normalize(to_camera), reflect(-normalize(to_light_array[i]), normalize(normal))));
-    
     totalLight += lightPower * (pow(specularK, 5) * 0.2  + diffuseK);
   }
-  
+
   vec3 incoming = lightColor * (totalLight + ambientK);
 
   color = vec4(reflectance * incoming, 1);
-}
\ No newline at end of file
+}
@@ -8,8 +8,6 @@ varying vec3 to_light, to_camera, normal;
 uniform sampler2D tex;
 uniform float ambientK;
 
-varying float unused_hack;
-
 void main()
 {
   vec2 tex_coord_wrapped = tex_coord - floor(tex_coord); // webgl can't handle GL_REPEAT (non 2^p textures), emulate it manually
@@ -23,5 +21,5 @@ void main()
   vec3 lightColor = vec3(0.9, 0.7, 0);
   vec3 incoming = lightColor * (lightPower * (pow(specularK, 5.0) * 0.2  + diffuseK) + ambientK);
 
-  gl_FragColor = vec4(reflectance * incoming, 1.0) + clamp(unused_hack, 0., 1e-10);
+  gl_FragColor = vec4(reflectance * incoming, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,12 @@
+// Per-frame data shared by all programs, uploaded once per frame (FrameData in graphics.hpp)
+
+// Light cluster grid: screen tiles x depth slices (LightClusters in lighting.hpp)
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+
+layout(std140) uniform Frame {
+  mat4 V;
+  mat4 P;
+  vec4 cluster_params; // viewport width, height, first slice depth, last slice depth
+};
@@ -1,11 +1,11 @@
 #version 330 core
 
+#include "frame.glsl"
+
 layout (location = 0) in vec3 pos_model;
 
 out vec3 tex_coord;
 
-uniform mat4 V, P;
-
 void main()
 {
   tex_coord = pos_model;
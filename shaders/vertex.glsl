@@ -1,35 +1,92 @@
 #version 330 core
 
-#define MAX_NUM_OF_LIGHTS 10
+#include "frame.glsl"
 
 layout(location = 0) in vec3 pos_model;
 layout(location = 2) in vec2 tex_coord_in;
+#ifdef OCT_NORMALS
+layout(location = 3) in vec2 normal_model;
+#else
 layout(location = 3) in vec3 normal_model;
+#endif
+
+#ifdef INSTANCED
+// Per instance, see InstanceData
+layout(location = 4) in mat4 instance_model;
+layout(location = 8) in vec4 instance_explosion_pos_time;
+layout(location = 9) in vec4 instance_explosion_dir_total;
+#endif
+
+#ifdef EXPLODING
+// Per face corner, see ExplosionVertex; the three corners of a triangle share these
+layout(location = 10) in vec3 explosion_centroid;
+layout(location = 11) in vec4 explosion_spin; // xyz - rotation axis (camera space), w - rotation speed
+#endif
 
 out VS_OUT {
   vec2 tex_coord;
-  vec3 to_camera, normal;
-  vec3 to_light_array[MAX_NUM_OF_LIGHTS];
+  vec3 pos_camspace, normal;
 };
 
-uniform mat4 M, V, P;
+uniform mat4 M;
+
+#if defined(EXPLODING) && !defined(INSTANCED)
+uniform float explosionTime;
+uniform float explosionTotalTime;
+uniform vec3 explosionDir_world;
+uniform vec3 explosionPos_world;
+#endif
 
-uniform vec3 light_pos_array[MAX_NUM_OF_LIGHTS];
-uniform int number_of_lights;
+#ifdef OCT_NORMALS
+vec3 octDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0)
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0 ? 1.0 : -1.0, n.y >= 0 ? 1.0 : -1.0);
+  return normalize(n);
+}
+#endif
+
+vec3 rotateAround(vec3 v, vec3 axis, float angle) {
+  vec4 q = vec4(sin(angle) * axis, cos(angle));
+  return v + 2 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
 
 void main() {
+#ifdef OCT_NORMALS
+  vec3 normal_decoded = octDecode(normal_model);
+#else
+  vec3 normal_decoded = normal_model;
+#endif
+#ifdef INSTANCED
+  mat4 model = instance_model;
+#else
+  mat4 model = M;
+#endif
   tex_coord = tex_coord_in;
-  gl_Position = V * M * vec4(pos_model, 1);
-  // gl_Position = P * V * M * vec4(pos_model, 1);
+  pos_camspace = (V * model * vec4(pos_model, 1)).xyz;
+  normal = (V * model * vec4(normal_decoded, 0.0)).xyz;
+
+#ifdef EXPLODING
+#ifdef INSTANCED
+  float explosionTime = instance_explosion_pos_time.w;
+  float explosionTotalTime = instance_explosion_dir_total.w;
+  vec3 explosionPos_world = instance_explosion_pos_time.xyz;
+  vec3 explosionDir_world = instance_explosion_dir_total.xyz;
+#endif
+  // The triangle flies away from the explosion, spinning around its centroid and shrinking
+  vec3 explosionPos = (V * vec4(explosionPos_world, 1)).xyz;
+  vec3 partPos = (V * model * vec4(explosion_centroid, 1)).xyz;
+
+  float explosionSpeed = 1 / (1 + pow(length(partPos - explosionPos), 6) * 100);
+  vec3 explosionDir = ((V * vec4(explosionDir_world, 0)).xyz) + 10 * normalize(partPos - explosionPos);
 
-  vec3 pos_camspace = (V * M * vec4(pos_model, 1.0)).xyz;
-  vec3 normal_camspace = (V * M * vec4(normal_model, 0.0)).xyz;
-  for (int i = 0; i < number_of_lights; ++i) {
-    to_light_array[i] = (V * vec4(light_pos_array[i], 1.0)).xyz - pos_camspace;
-  }
+  float scale = 1 - explosionTime / explosionTotalTime;
+  vec3 shift = explosionSpeed * explosionTime * explosionDir;
+  float angle = explosion_spin.w * explosionTime;
 
-  vec3 camera_pos_camspace = vec3(0.0, 0.0, 0.0);
+  normal = rotateAround(normal, explosion_spin.xyz, angle);
+  pos_camspace = partPos + scale * rotateAround(pos_camspace - partPos, explosion_spin.xyz, angle) + shift;
+#endif
 
-  normal = normal_camspace;
-  to_camera = camera_pos_camspace - pos_camspace;
-}
\ No newline at end of file
+  gl_Position = P * vec4(pos_camspace, 1);
+}
@@ -1,13 +1,11 @@
 #version 100
 
 attribute vec3 pos_model;
-attribute vec3 color_unused;
 attribute vec2 tex_coord_in;
 attribute vec3 normal_model;
 
 varying vec2 tex_coord;
 varying vec3 to_light, to_camera, normal;
-varying float unused_hack;
 
 uniform sampler2D tex;
 uniform vec3 light_pos;
@@ -15,8 +13,6 @@ uniform mat4 M, V, P;
 
 void main()
 {
-  unused_hack = color_unused.x;
-
   tex_coord = tex_coord_in;
   gl_Position = P * V * M * vec4(pos_model, 1.0);
 
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <GL/glew.h>
+
+/**
+ * Ring buffer for data that is rewritten every frame (instances, the Frame uniform block).
+ *
+ * The buffer holds FRAMES regions; each frame writes into the next one while the GPU may
+ * still read the previous ones. Where ARB_buffer_storage is available the buffer is mapped
+ * once, persistently and coherently, and writes go straight to it; a fence per region makes
+ * sure the CPU does not overwrite data a frame in flight still uses. Without it, writes go to
+ * a CPU staging copy that flush() uploads into an orphaned buffer; that is the only path
+ * compiled for WebGL 1, which has neither mapping nor fences.
+ *
+ * Per frame: beginFrame(bytes), allocate(...) and write, flush(), then draw using offset().
+ */
+class StreamBuffer {
+ public:
+  static constexpr int FRAMES = 3;
+
+  static bool persistentSupported() {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    return GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+#endif
+  }
+
+  explicit StreamBuffer(size_t frame_capacity = 64 * 1024) : persistent_(persistentSupported()) {
+#ifndef __EMSCRIPTEN__
+    int alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    uniform_alignment_ = std::max(alignment, 16);
+#endif
+    create(frame_capacity);
+  }
+
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+  ~StreamBuffer() {
+    destroy();
+  }
+
+  [[nodiscard]] uint buffer() const {
+    return buffer_;
+  }
+
+  [[nodiscard]] bool persistent() const {
+    return persistent_;
+  }
+
+  [[nodiscard]] size_t uniformAlignment() const {
+    return uniform_alignment_;
+  }
+
+  /**
+   * Bytes written during the last finished frame.
+   */
+  [[nodiscard]] size_t bytesStreamed() const {
+    return bytes_streamed_;
+  }
+
+  /**
+   * How many times beginFrame found the GPU still reading the region it was about to reuse.
+   */
+  [[nodiscard]] uint64_t fenceWaits() const {
+    return fence_waits_;
+  }
+
+  /**
+   * Moves to the next region, making sure it can hold `bytes`.
+   */
+  void beginFrame(size_t bytes) {
+    if (bytes > frame_capacity_) {
+      // The GPU keeps the old buffer alive until frames in flight are done with it
+      size_t capacity = frame_capacity_;
+      while (capacity < bytes)
+        capacity *= 2;
+      destroy();
+      create(capacity);
+    }
+
+    region_ = (region_ + 1) % FRAMES;
+    used_ = 0;
+#ifndef __EMSCRIPTEN__
+    if (persistent_ && fences_[region_]) {
+      GLenum status = glClientWaitSync(fences_[region_], 0, 0);
+      if (status == GL_TIMEOUT_EXPIRED) {
+        fence_waits_++;
+        do {
+          status = glClientWaitSync(fences_[region_], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+        } while (status == GL_TIMEOUT_EXPIRED);
+      }
+      glDeleteSync(fences_[region_]);
+      fences_[region_] = nullptr;
+    }
+#endif
+  }
+
+  /**
+   * `bytes` of space in the current frame, at an `alignment` multiple. Must fit the beginFrame request.
+   */
+  void *allocate(size_t bytes, size_t alignment = 16) {
+    size_t offset = (used_ + alignment - 1) / alignment * alignment;
+    if (offset + bytes > frame_capacity_)
+      return nullptr;
+    used_ = offset + bytes;
+    return frameBase() + offset;
+  }
+
+  template <typename T>
+  T *allocate(size_t count = 1, size_t alignment = 16) {
+    return static_cast<T*>(allocate(sizeof(T) * count, alignment));
+  }
+
+  /**
+   * Byte offset in buffer() of memory returned by allocate, for glBindBufferRange or attribute pointers.
+   */
+  [[nodiscard]] size_t offset(const void *data) {
+    return regionBase() + (static_cast<const uint8_t*>(data) - frameBase());
+  }
+
+  /**
+   * Makes this frame's writes visible to the GPU. Call after the last write and before the first draw.
+   */
+  void flush() {
+    bytes_streamed_ = used_;
+    if (persistent_)
+      return; // coherent mapping
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    glBufferData(GL_ARRAY_BUFFER, frame_capacity_, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, used_, staging_.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  /**
+   * Fences the region after the frame's draws have been issued.
+   */
+  void endFrame() {
+#ifndef __EMSCRIPTEN__
+    if (persistent_)
+      fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+  }
+
+ private:
+  static constexpr uint64_t FENCE_TIMEOUT_NS = 1000000;
+
+  bool persistent_;
+  size_t uniform_alignment_ = 16;
+  size_t frame_capacity_ = 0;
+  uint buffer_ = 0;
+  uint8_t *mapped_ = nullptr;
+  std::vector<uint8_t> staging_;
+#ifndef __EMSCRIPTEN__
+  GLsync fences_[FRAMES] = {};
+#endif
+  int region_ = 0;
+  size_t used_ = 0;
+
+  size_t bytes_streamed_ = 0;
+  uint64_t fence_waits_ = 0;
+
+  [[nodiscard]] size_t regionBase() const {
+    return (persistent_ ? region_ * frame_capacity_ : 0);
+  }
+
+  [[nodiscard]] uint8_t *frameBase() {
+    return (persistent_ ? mapped_ + regionBase() : staging_.data());
+  }
+
+  void create(size_t frame_capacity) {
+    // Regions start at uniform-buffer-aligned offsets
+    frame_capacity_ = (frame_capacity + uniform_alignment_ - 1) / uniform_alignment_ * uniform_alignment_;
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+#ifndef __EMSCRIPTEN__
+    if (persistent_) {
+      GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_ARRAY_BUFFER, frame_capacity_ * FRAMES, nullptr, flags);
+      mapped_ = static_cast<uint8_t*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, frame_capacity_ * FRAMES, flags));
+      if (!mapped_) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDeleteBuffers(1, &buffer_);
+        persistent_ = false;
+        create(frame_capacity);
+        return;
+      }
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      return;
+    }
+#endif
+    glBufferData(GL_ARRAY_BUFFER, frame_capacity_, nullptr, GL_STREAM_DRAW);
+    staging_.assign(frame_capacity_, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  void destroy() {
+#ifndef __EMSCRIPTEN__
+    for (GLsync &fence : fences_) {
+      if (fence)
+        glDeleteSync(fence);
+      fence = nullptr;
+    }
+    if (mapped_) {
+      glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      mapped_ = nullptr;
+    }
+#endif
+    glDeleteBuffers(1, &buffer_);
+    buffer_ = 0;
+  }
+};
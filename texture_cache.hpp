@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+
+#include "blob.hpp"
+#include "mapped_file.hpp"
+#include "texture_data.hpp"
+
+/**
+ * Baked texture container: a header with the mip level table followed by the level blobs,
+ * ready to be memory-mapped and handed to glTexImage2D / glCompressedTexImage2D as is.
+ * Written by bake_texture next to the source as `<source>.texbin` and stamped with a hash
+ * of the source file, like mesh_cache. Unlike meshes, the game never writes these itself:
+ * without a baked file it decodes the source image as before.
+ */
+namespace texture_cache {
+
+constexpr char MAGIC[4] = {'T', 'E', 'X', 'B'};
+constexpr uint32_t VERSION = 1;
+constexpr uint64_t BLOB_ALIGNMENT = 16;
+
+struct Level {
+  uint64_t offset;
+  uint64_t size;
+  uint32_t width;
+  uint32_t height;
+};
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint64_t source_hash;
+
+  TextureFormat format;
+  uint32_t flipped; // rows stored bottom to top, as 2D textures are loaded
+  uint32_t level_count;
+  uint32_t reserved;
+
+  Level levels[MAX_TEXTURE_LEVELS];
+};
+
+inline std::string cachePath(const std::string &source_path) {
+  return source_path + ".texbin";
+}
+
+inline bool write(const std::string &path, const TextureView &texture, bool flipped, uint64_t source_hash) {
+  Header header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.source_hash = source_hash;
+  header.format = texture.format;
+  header.flipped = flipped;
+  header.level_count = texture.level_count;
+  uint64_t offset = alignUp(sizeof(Header), BLOB_ALIGNMENT);
+  for (uint32_t i = 0; i < texture.level_count; i++) {
+    header.levels[i] = {offset, texture.levels[i].size, texture.levels[i].width, texture.levels[i].height};
+    offset = alignUp(offset + texture.levels[i].size, BLOB_ALIGNMENT);
+  }
+
+  std::ofstream fout(path, std::ios::binary | std::ios::trunc);
+  if (!fout)
+    return false;
+
+  auto padTo = [&](uint64_t offset) {
+    static const char zeros[BLOB_ALIGNMENT] = {};
+    fout.write(zeros, (std::streamsize)(offset - (uint64_t)fout.tellp()));
+  };
+  fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (uint32_t i = 0; i < texture.level_count; i++) {
+    padTo(header.levels[i].offset);
+    fout.write(static_cast<const char*>(texture.levels[i].data), (std::streamsize)texture.levels[i].size);
+  }
+  return (bool)fout;
+}
+
+/**
+ * A memory-mapped container. Pointers stay valid while the object lives.
+ */
+class CachedTexture {
+ public:
+  explicit CachedTexture(MappedFile file) : file_(std::move(file)) {
+  }
+
+  [[nodiscard]] const Header &header() const {
+    return *reinterpret_cast<const Header*>(file_.data());
+  }
+
+  [[nodiscard]] TextureView view() const {
+    const Header &h = header();
+    TextureView result;
+    result.format = h.format;
+    result.level_count = h.level_count;
+    for (uint32_t i = 0; i < h.level_count; i++)
+      result.levels[i] = {h.levels[i].width, h.levels[i].height, file_.data() + h.levels[i].offset, (size_t)h.levels[i].size};
+    return result;
+  }
+
+ private:
+  MappedFile file_;
+};
+
+/**
+ * Maps the container if it exists, is well-formed, was baked from a source with `source_hash`
+ * and stores its rows in the requested order.
+ */
+inline std::optional<CachedTexture> open(const std::string &path, uint64_t source_hash, bool flipped) {
+  MappedFile file(path);
+  if (!file.isOpen() || file.size() < sizeof(Header))
+    return std::nullopt;
+
+  Header header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  bool valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+      && header.version == VERSION
+      && header.source_hash == source_hash
+      && header.flipped == (uint32_t)flipped
+      && header.format <= TextureFormat::bc3
+      && header.level_count >= 1 && header.level_count <= MAX_TEXTURE_LEVELS;
+  for (uint32_t i = 0; valid && i < header.level_count; i++) {
+    const Level &level = header.levels[i];
+    valid = level.offset + level.size <= file.size()
+        && level.width == std::max(1u, header.levels[0].width >> i)
+        && level.height == std::max(1u, header.levels[0].height >> i)
+        && level.size == levelSize(header.format, level.width, level.height);
+  }
+  // Full chains only, the runtime samples them with mipmapping
+  valid = valid && header.levels[header.level_count - 1].width == 1 && header.levels[header.level_count - 1].height == 1;
+  if (!valid)
+    return std::nullopt;
+  return CachedTexture(std::move(file));
+}
+
+} // namespace texture_cache
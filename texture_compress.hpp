@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "texture_data.hpp"
+
+/**
+ * Offline texture processing: box-filtered mip chains and a CPU BC1/BC3 (DXT1/DXT5) encoder.
+ *
+ * Colour endpoints are the extremes of the block's pixels projected on their principal
+ * axis, then every pixel takes the nearest of the four palette entries. Not the best
+ * quality an encoder can get, but close to it for photographic textures and fast enough
+ * to bake at startup-sized resolutions in well under a second.
+ */
+namespace texture_compress {
+
+/**
+ * `base` followed by every level down to 1x1, each the 2x2 average of the previous one.
+ */
+inline std::vector<Image> buildMips(const Image &base) {
+  std::vector<Image> levels{base};
+  while (levels.back().width > 1 || levels.back().height > 1) {
+    const Image &src = levels.back();
+    Image dst{std::max(1, src.width / 2), std::max(1, src.height / 2), src.channels, {}};
+    dst.pixels.resize((size_t)dst.width * dst.height * dst.channels);
+    for (int y = 0; y < dst.height; y++) {
+      int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+      for (int x = 0; x < dst.width; x++) {
+        int x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+        for (int c = 0; c < src.channels; c++) {
+          auto at = [&](int sx, int sy) { return (int)src.pixels[((size_t)sy * src.width + sx) * src.channels + c]; };
+          dst.pixels[((size_t)y * dst.width + x) * dst.channels + c] =
+              (unsigned char)((at(x0, y0) + at(x1, y0) + at(x0, y1) + at(x1, y1) + 2) / 4);
+        }
+      }
+    }
+    levels.push_back(std::move(dst));
+  }
+  return levels;
+}
+
+/**
+ * A 4x4 block of RGBA pixels, row-major.
+ */
+using Block = uint8_t[16][4];
+
+inline uint16_t toRgb565(const float rgb[3]) {
+  auto q = [](float v, int max) { return (uint16_t)std::clamp((int)std::lround(v / 255.0f * max), 0, max); };
+  return (uint16_t)(q(rgb[0], 31) << 11 | q(rgb[1], 63) << 5 | q(rgb[2], 31));
+}
+
+inline void fromRgb565(uint16_t c, int rgb[3]) {
+  int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+/**
+ * The four-colour palette of a BC1 block with color0 > color1.
+ */
+inline void bc1Palette(uint16_t c0, uint16_t c1, int palette[4][3]) {
+  fromRgb565(c0, palette[0]);
+  fromRgb565(c1, palette[1]);
+  for (int k = 0; k < 3; k++) {
+    palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+    palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+  }
+}
+
+/**
+ * 8 bytes: two RGB565 endpoints, then 2-bit palette indices. Always uses the four-colour
+ * mode (color0 > color1), which BC3 requires of its colour half.
+ */
+inline void encodeBC1Block(const Block &block, uint8_t *out) {
+  float mean[3] = {};
+  for (const auto &p : block) {
+    for (int k = 0; k < 3; k++)
+      mean[k] += p[k] / 16.0f;
+  }
+  float cov[6] = {}; // rr rg rb gg gb bb
+  for (const auto &p : block) {
+    float d[3] = {p[0] - mean[0], p[1] - mean[1], p[2] - mean[2]};
+    cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+    cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+  }
+  // Principal axis by power iteration, starting from the luminance direction
+  float axis[3] = {0.3f, 0.6f, 0.1f};
+  for (int iteration = 0; iteration < 8; iteration++) {
+    float next[3] = {
+        cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+        cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+        cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+    float length = std::max({std::fabs(next[0]), std::fabs(next[1]), std::fabs(next[2])});
+    if (length < 1e-6f)
+      break;
+    for (int k = 0; k < 3; k++)
+      axis[k] = next[k] / length;
+  }
+
+  float min_t = 1e30f, max_t = -1e30f;
+  for (const auto &p : block) {
+    float t = (p[0] - mean[0]) * axis[0] + (p[1] - mean[1]) * axis[1] + (p[2] - mean[2]) * axis[2];
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+  float axis_length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+  float hi[3], lo[3];
+  for (int k = 0; k < 3; k++) {
+    hi[k] = mean[k] + axis[k] * max_t / std::max(axis_length2, 1e-12f);
+    lo[k] = mean[k] + axis[k] * min_t / std::max(axis_length2, 1e-12f);
+  }
+  uint16_t c0 = toRgb565(hi), c1 = toRgb565(lo);
+  if (c0 < c1)
+    std::swap(c0, c1);
+
+  uint32_t indices = 0;
+  if (c0 != c1) {
+    int palette[4][3];
+    bc1Palette(c0, c1, palette);
+    for (int i = 0; i < 16; i++) {
+      int best = 0, best_error = INT32_MAX;
+      for (int j = 0; j < 4; j++) {
+        int error = 0;
+        for (int k = 0; k < 3; k++)
+          error += (block[i][k] - palette[j][k]) * (block[i][k] - palette[j][k]);
+        if (error < best_error) {
+          best_error = error;
+          best = j;
+        }
+      }
+      indices |= (uint32_t)best << (2 * i);
+    }
+  }
+  std::memcpy(out, &c0, 2);
+  std::memcpy(out + 2, &c1, 2);
+  std::memcpy(out + 4, &indices, 4);
+}
+
+/**
+ * 16 bytes: the alpha half (two endpoints, 3-bit indices into eight interpolated values),
+ * then a BC1 colour block.
+ */
+inline void encodeBC3Block(const Block &block, uint8_t *out) {
+  uint8_t a0 = 0, a1 = 255;
+  for (const auto &p : block) {
+    a0 = std::max(a0, p[3]);
+    a1 = std::min(a1, p[3]);
+  }
+  uint64_t indices = 0;
+  if (a0 != a1) {
+    int palette[8] = {a0, a1};
+    for (int j = 1; j < 7; j++)
+      palette[j + 1] = ((7 - j) * a0 + j * a1) / 7;
+    for (int i = 0; i < 16; i++) {
+      int best = 0;
+      for (int j = 1; j < 8; j++) {
+        if (std::abs(block[i][3] - palette[j]) < std::abs(block[i][3] - palette[best]))
+          best = j;
+      }
+      indices |= (uint64_t)best << (3 * i);
+    }
+  }
+  out[0] = a0;
+  out[1] = a1;
+  for (int k = 0; k < 6; k++)
+    out[2 + k] = (uint8_t)(indices >> (8 * k));
+  encodeBC1Block(block, out + 8);
+}
+
+/**
+ * Inverse of encodeBC1Block / encodeBC3Block, for measuring the error of the encoder.
+ */
+inline void decodeBlock(TextureFormat format, const uint8_t *in, Block &block) {
+  if (format == TextureFormat::bc3) {
+    int palette[8] = {in[0], in[1]};
+    for (int j = 1; j < 7; j++)
+      palette[j + 1] = (in[0] > in[1] ? ((7 - j) * in[0] + j * in[1]) / 7 : 0);
+    if (in[0] <= in[1]) {
+      // Six-value mode, never written by the encoder
+      for (int j = 1; j < 5; j++)
+        palette[j + 1] = ((5 - j) * in[0] + j * in[1]) / 5;
+      palette[6] = 0;
+      palette[7] = 255;
+    }
+    uint64_t indices = 0;
+    for (int k = 0; k < 6; k++)
+      indices |= (uint64_t)in[2 + k] << (8 * k);
+    for (int i = 0; i < 16; i++)
+      block[i][3] = (uint8_t)palette[(indices >> (3 * i)) & 7];
+    in += 8;
+  } else {
+    for (auto &p : block)
+      p[3] = 255;
+  }
+
+  uint16_t c0, c1;
+  uint32_t indices;
+  std::memcpy(&c0, in, 2);
+  std::memcpy(&c1, in + 2, 2);
+  std::memcpy(&indices, in + 4, 4);
+  int palette[4][3];
+  bc1Palette(c0, c1, palette);
+  for (int i = 0; i < 16; i++) {
+    for (int k = 0; k < 3; k++)
+      block[i][k] = (uint8_t)palette[(indices >> (2 * i)) & 3][k];
+  }
+}
+
+/**
+ * Visits the 4x4 blocks of `image` in storage order, edge pixels replicated into the padding.
+ */
+template <typename TFunc>
+void forEachBlock(int width, int height, TFunc &&f) {
+  for (int by = 0; by < (height + 3) / 4; by++) {
+    for (int bx = 0; bx < (width + 3) / 4; bx++)
+      f(bx, by);
+  }
+}
+
+inline void readBlock(const Image &image, int bx, int by, Block &block) {
+  for (int i = 0; i < 16; i++) {
+    int x = std::min(bx * 4 + i % 4, image.width - 1), y = std::min(by * 4 + i / 4, image.height - 1);
+    const unsigned char *p = &image.pixels[((size_t)y * image.width + x) * image.channels];
+    for (int k = 0; k < 4; k++)
+      block[i][k] = (k < image.channels ? p[k] : 255);
+  }
+}
+
+/**
+ * The mip chain of `base` in `format`. BC3 keeps the alpha of RGBA images, the other
+ * formats ignore it.
+ */
+inline EncodedTexture encode(const Image &base, TextureFormat format) {
+  EncodedTexture result;
+  result.format = format;
+  for (const Image &level : buildMips(base)) {
+    EncodedTexture::Level encoded{(uint32_t)level.width, (uint32_t)level.height, {}};
+    encoded.bytes.resize(levelSize(format, encoded.width, encoded.height));
+    if (format == TextureFormat::rgb8) {
+      for (size_t i = 0; i < (size_t)level.width * level.height; i++)
+        std::memcpy(&encoded.bytes[i * 3], &level.pixels[i * level.channels], 3);
+    } else {
+      size_t block_size = (format == TextureFormat::bc1 ? 8 : 16);
+      int blocks_per_row = (level.width + 3) / 4;
+      forEachBlock(level.width, level.height, [&](int bx, int by) {
+        Block block;
+        readBlock(level, bx, by, block);
+        uint8_t *out = &encoded.bytes[((size_t)by * blocks_per_row + bx) * block_size];
+        if (format == TextureFormat::bc1)
+          encodeBC1Block(block, out);
+        else
+          encodeBC3Block(block, out);
+      });
+    }
+    result.levels.push_back(std::move(encoded));
+  }
+  return result;
+}
+
+/**
+ * Root mean square error per channel of the finest level of `encoded` against `base`.
+ */
+inline double rmse(const Image &base, const EncodedTexture &encoded) {
+  const EncodedTexture::Level &level = encoded.levels[0];
+  int channels = (encoded.format == TextureFormat::bc3 ? std::min(base.channels, 4) : 3);
+  double sum = 0;
+  size_t blocks_per_row = (level.width + 3) / 4;
+  size_t block_size = (encoded.format == TextureFormat::bc1 ? 8 : 16);
+  forEachBlock(base.width, base.height, [&](int bx, int by) {
+    Block original, decoded;
+    readBlock(base, bx, by, original);
+    if (encoded.format == TextureFormat::rgb8)
+      std::memcpy(decoded, original, sizeof(Block)); // lossless
+    else
+      decodeBlock(encoded.format, &level.bytes[(by * blocks_per_row + bx) * block_size], decoded);
+    for (int i = 0; i < 16; i++) {
+      if (bx * 4 + i % 4 >= base.width || by * 4 + i / 4 >= base.height)
+        continue;
+      for (int k = 0; k < channels; k++)
+        sum += (original[i][k] - decoded[i][k]) * (original[i][k] - decoded[i][k]);
+    }
+  });
+  return std::sqrt(sum / ((double)base.width * base.height * channels));
+}
+
+} // namespace texture_compress
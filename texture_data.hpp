@@ -0,0 +1,100 @@
+#pragma once
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * 8-bit RGB or RGBA pixels, tightly packed, rows in the order GL expects them.
+ */
+struct Image {
+  int width = 0;
+  int height = 0;
+  int channels = 3;
+  std::vector<unsigned char> pixels;
+};
+
+/**
+ * Safe to call from any thread: stbi's flip flag is global, so rows are flipped here instead.
+ */
+inline Image decodeImage(const std::string& path, bool flip_vertically, int channels = 3) {
+  int width, height, file_channels;
+  unsigned char *data = stbi_load(path.c_str(), &width, &height, &file_channels, channels);
+  assert(data);
+  Image image{width, height, channels, std::vector<unsigned char>(data, data + (size_t)width * height * channels)};
+  stbi_image_free(data);
+
+  if (flip_vertically) {
+    size_t row = (size_t)width * channels;
+    for (int y = 0; y < height / 2; y++)
+      std::swap_ranges(&image.pixels[y * row], &image.pixels[(y + 1) * row], &image.pixels[(height - 1 - y) * row]);
+  }
+  return image;
+}
+
+/**
+ * GPU texture formats:
+ * rgb8 - uncompressed, 3 bytes per pixel
+ * bc1  - S3TC DXT1, 8 bytes per 4x4 block, opaque
+ * bc3  - S3TC DXT5, 16 bytes per 4x4 block, with alpha
+ */
+enum class TextureFormat : uint32_t { rgb8 = 0, bc1 = 1, bc3 = 2 };
+
+constexpr uint32_t MAX_TEXTURE_LEVELS = 16;
+
+inline bool isCompressed(TextureFormat format) {
+  return format != TextureFormat::rgb8;
+}
+
+/**
+ * Bytes of one mip level, blocks are padded to 4x4 pixels.
+ */
+inline size_t levelSize(TextureFormat format, uint32_t width, uint32_t height) {
+  if (format == TextureFormat::rgb8)
+    return (size_t)width * height * 3;
+  size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+  return blocks * (format == TextureFormat::bc1 ? 8 : 16);
+}
+
+struct TextureLevelView {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  const void *data = nullptr;
+  size_t size = 0;
+};
+
+/**
+ * A full mip chain, finest first, pointing into memory owned by someone else.
+ */
+struct TextureView {
+  TextureFormat format = TextureFormat::rgb8;
+  uint32_t level_count = 0;
+  TextureLevelView levels[MAX_TEXTURE_LEVELS];
+};
+
+/**
+ * Owning counterpart of TextureView, as produced by texture_compress::encode.
+ */
+struct EncodedTexture {
+  struct Level {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> bytes;
+  };
+
+  TextureFormat format = TextureFormat::rgb8;
+  std::vector<Level> levels;
+
+  [[nodiscard]] TextureView view() const {
+    TextureView result;
+    result.format = format;
+    result.level_count = (uint32_t)levels.size();
+    for (uint32_t i = 0; i < result.level_count; i++)
+      result.levels[i] = {levels[i].width, levels[i].height, levels[i].bytes.data(), levels[i].bytes.size()};
+    return result;
+  }
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads for data-parallel loops.
+ * The calling thread takes part in the work, so a pool with 0 workers runs everything inline.
+ * parallelFor is meant to be called from one thread at a time and not from inside a task.
+ *
+ * Work stealing: each thread starts with an equal contiguous share of the indices and takes
+ * them from the front, one at a time; a thread that runs out takes the back half of another
+ * thread's remaining share. Threads mostly touch their own share's cache line and
+ * neighbouring indices, and uneven tasks still balance out.
+ */
+class ThreadPool {
+ public:
+  static unsigned defaultWorkerCount() {
+#ifdef __EMSCRIPTEN__
+    return 0;
+#else
+    return std::max(1u, std::thread::hardware_concurrency()) - 1;
+#endif
+  }
+
+  explicit ThreadPool(unsigned workers = defaultWorkerCount()) : shares_(workers + 1) {
+    for (unsigned i = 0; i < workers; i++)
+      workers_.emplace_back([this, i] { workerLoop(i + 1); });
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &worker : workers_)
+      worker.join();
+  }
+
+  /**
+   * Workers plus the calling thread.
+   */
+  [[nodiscard]] size_t threadCount() const {
+    return workers_.size() + 1;
+  }
+
+  /**
+   * Calls f(i) for every i < count (below 2^32), spread over the pool; returns when all calls are done.
+   */
+  template <typename TFunc>
+  void parallelFor(size_t count, TFunc &&f) {
+    if (workers_.empty() || count <= 1) {
+      for (size_t i = 0; i < count; i++)
+        f(i);
+      return;
+    }
+
+    std::function<void(size_t)> task = [&f](size_t i) { f(i); };
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &task;
+      for (size_t t = 0; t < shares_.size(); t++)
+        shares_[t].range = pack(count * t / shares_.size(), count * (t + 1) / shares_.size());
+      busy_ = workers_.size();
+      generation_++;
+    }
+    wake_.notify_all();
+    runTasks(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return busy_ == 0; });
+    task_ = nullptr;
+  }
+
+ private:
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_, done_;
+  bool stop_ = false;
+  uint64_t generation_ = 0;
+  size_t busy_ = 0;
+
+  /**
+   * Indices [begin, end) not started yet, packed as begin << 32 | end so that the owner
+   * taking the front and thieves taking the back agree through one compare-and-swap.
+   */
+  struct alignas(64) Share {
+    std::atomic<uint64_t> range{0};
+  };
+
+  const std::function<void(size_t)> *task_ = nullptr;
+  std::vector<Share> shares_;
+
+  static uint64_t pack(uint64_t begin, uint64_t end) {
+    return begin << 32 | end;
+  }
+
+  static uint32_t begin(uint64_t range) {
+    return (uint32_t)(range >> 32);
+  }
+
+  static uint32_t end(uint64_t range) {
+    return (uint32_t)range;
+  }
+
+  bool takeFront(Share &share, size_t &index) {
+    uint64_t range = share.range.load();
+    while (begin(range) < end(range)) {
+      if (share.range.compare_exchange_weak(range, pack(begin(range) + 1, end(range)))) {
+        index = begin(range);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Moves the back half (at least one index) of some other share into `self`.
+   */
+  bool steal(size_t self) {
+    for (size_t k = 1; k < shares_.size(); k++) {
+      Share &victim = shares_[(self + k) % shares_.size()];
+      uint64_t range = victim.range.load();
+      while (begin(range) < end(range)) {
+        uint32_t middle = begin(range) + (end(range) - begin(range)) / 2;
+        if (victim.range.compare_exchange_weak(range, pack(begin(range), middle))) {
+          shares_[self].range.store(pack(middle, end(range)));
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  void runTasks(size_t self) {
+    size_t index;
+    do {
+      while (takeFront(shares_[self], index))
+        (*task_)(index);
+    } while (steal(self));
+  }
+
+  void workerLoop(size_t self) {
+    uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_)
+          return;
+        seen = generation_;
+      }
+      runTasks(self);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_ == 0)
+          done_.notify_one();
+      }
+    }
+  }
+};
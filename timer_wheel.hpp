@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Hierarchical timer wheel: timers are scheduled once and fired when time passes them,
+ * in amortized O(1) per timer; ticks without expiries or cascades do no per-timer work.
+ *
+ * Time is counted in ticks of `resolution` seconds. Level 0 has one slot per tick for the
+ * next SLOTS ticks, each higher level one slot per SLOTS ticks of the level below. A timer
+ * goes into the lowest level whose span covers it and moves down a level ("cascades") when
+ * time reaches its slot. Timers are never fired early, and at most one tick late.
+ * Timers farther out than the whole wheel wait in the top level and cascade again.
+ *
+ * There is no cancellation; payloads that may go stale (entity handles) are checked when fired.
+ */
+template <typename TPayload>
+class TimerWheel {
+ public:
+  static constexpr uint32_t SLOT_BITS = 6;
+  static constexpr uint32_t SLOTS = 1 << SLOT_BITS;
+  static constexpr uint32_t LEVELS = 4;
+
+  explicit TimerWheel(double resolution) : resolution_(resolution) {
+  }
+
+  [[nodiscard]] double resolution() const {
+    return resolution_;
+  }
+
+  /**
+   * Timers scheduled and not fired yet.
+   */
+  [[nodiscard]] size_t size() const {
+    return size_;
+  }
+
+  /**
+   * Fires `payload` once time reaches `time` seconds; times already passed fire on the next advance.
+   */
+  void schedule(double time, const TPayload &payload) {
+    uint64_t due = (uint64_t)std::ceil(std::max(time, 0.0) / resolution_);
+    insert({std::max(due, now_), payload});
+    size_++;
+  }
+
+  /**
+   * Moves time forward to `time` seconds, calling fire(payload) for every timer due by then.
+   * fire may schedule new timers.
+   */
+  template <typename TFunc>
+  void advance(double time, TFunc &&fire) {
+    uint64_t target = (uint64_t)std::floor(std::max(time, 0.0) / resolution_);
+    while (now_ <= target) {
+      if (size_ == 0) {
+        now_ = target + 1; // nothing to cascade or fire on the way
+        break;
+      }
+      step(fire);
+    }
+  }
+
+ private:
+  struct Timer {
+    uint64_t due; // tick
+    TPayload payload;
+  };
+
+  double resolution_;
+  uint64_t now_ = 0; // next tick to process
+  size_t size_ = 0;
+  std::vector<Timer> slots_[LEVELS][SLOTS];
+  std::vector<Timer> scratch_;
+
+  static uint32_t slotIndex(uint64_t tick, uint32_t level) {
+    return (uint32_t)(tick >> (level * SLOT_BITS)) & (SLOTS - 1);
+  }
+
+  void insert(const Timer &timer) {
+    uint64_t delta = timer.due - now_;
+    uint32_t level = 0;
+    while (level + 1 < LEVELS && delta >= (uint64_t)1 << ((level + 1) * SLOT_BITS))
+      level++;
+    // Beyond the top level's span, park it in its last slot; it is reinserted from there
+    uint64_t at = std::min(timer.due, now_ + ((uint64_t)1 << (LEVELS * SLOT_BITS)) - 1);
+    slots_[level][slotIndex(at, level)].push_back(timer);
+  }
+
+  template <typename TFunc>
+  void step(TFunc &fire) {
+    uint64_t tick = now_;
+    // Top down, so a timer can cascade through several levels in one tick
+    for (uint32_t level = LEVELS - 1; level >= 1; level--) {
+      if ((tick & (((uint64_t)1 << (level * SLOT_BITS)) - 1)) != 0)
+        continue;
+      scratch_.swap(slots_[level][slotIndex(tick, level)]);
+      for (const Timer &timer : scratch_)
+        insert(timer);
+      scratch_.clear();
+    }
+
+    // Past this tick before firing, so timers scheduled by fire never land in the slot being emptied
+    now_++;
+    scratch_.swap(slots_[0][slotIndex(tick, 0)]);
+    size_ -= scratch_.size();
+    for (const Timer &timer : scratch_)
+      fire(timer.payload);
+    scratch_.clear();
+  }
+};
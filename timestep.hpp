@@ -0,0 +1,54 @@
+#pragma once
+
+#include <algorithm>
+
+/**
+ * Fixed-step accumulator: turns variable frame times into a whole number of
+ * equal simulation ticks, so the simulation does not depend on the frame rate.
+ */
+class FixedTimestep {
+ public:
+  FixedTimestep(double tick_rate, int max_ticks_per_frame)
+        : tick_duration_(1.0 / tick_rate)
+        , max_ticks_per_frame_(max_ticks_per_frame) {
+  }
+
+  /**
+   * Adds elapsed time and returns how many ticks to simulate now.
+   * Anything beyond max_ticks_per_frame is dropped so a slow frame can't snowball.
+   */
+  int advance(double elapsed_time) {
+    accumulator_ += elapsed_time;
+    int ticks = (int)(accumulator_ / tick_duration_);
+    if (ticks > max_ticks_per_frame_) {
+      dropped_ticks_ += ticks - max_ticks_per_frame_;
+      ticks = max_ticks_per_frame_;
+      accumulator_ = tick_duration_ * ticks;
+    }
+    accumulator_ -= tick_duration_ * ticks;
+    // Guard against rounding leaving the accumulator a hair outside [0, tick)
+    accumulator_ = std::clamp(accumulator_, 0.0, tick_duration_);
+    return ticks;
+  }
+
+  [[nodiscard]] double tickDuration() const {
+    return tick_duration_;
+  }
+
+  /**
+   * How far the renderer is between the previous and the latest tick, in [0, 1].
+   */
+  [[nodiscard]] double alpha() const {
+    return accumulator_ / tick_duration_;
+  }
+
+  [[nodiscard]] long long droppedTicks() const {
+    return dropped_ticks_;
+  }
+
+ private:
+  double tick_duration_;
+  int max_ticks_per_frame_;
+  double accumulator_ = 0;
+  long long dropped_ticks_ = 0;
+};
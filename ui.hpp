@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
@@ -8,6 +11,8 @@
 #include <GLFW/glfw3.h>
 
 #include "world.hpp"
+#include "graphics.hpp"
+#include "frame_pacer.hpp"
 
 struct UI {
   UI(GLFWwindow *window) {
@@ -19,7 +24,8 @@ struct UI {
     ImGui_ImplOpenGL3_Init("#version 100"); // glsl version
   }
 
-  void draw(float elapsed_time, float timeSpeed, Scene &scene) {
+  void draw(float elapsed_time, float timeSpeed, Scene &scene, Graphics &graphics, const FramePacer &pacer) {
+    auto cpu_scope = graphics.profiler.cpu("ui");
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
 
@@ -41,12 +47,23 @@ struct UI {
       ImGui::SetNextWindowBgAlpha(0.35f); // Transparent background
       if (ImGui::Begin("overlay", p_open, window_flags))
       {
-        ImGui::Text("Controls:\nMove - w/a/s/d\nLook - mouse\nShoot - LMB\nTime control - up/down arrows");
+        ImGui::Text("Controls:\nMove - w/a/s/d\nLook - mouse\nShoot - LMB\nTime control - up/down arrows\nInstancing - i\nLOD - l\nSave profiler trace - p");
         ImGui::Separator();
         ImGui::Text("FPS: %.1f", (elapsed_time ? 1.0f / elapsed_time : 0));
+        ImGui::Text("Pacing: %s, frame %.2f +- %.2f ms, missed %llu", pacingModeName(pacer.mode()),
+                    pacer.meanInterval() * 1e3, pacer.jitter() * 1e3, (unsigned long long)pacer.missedDeadlines());
         ImGui::Text("Enemies alive: %d", (int)scene.enemies.size());
         ImGui::Text("Enemies killed: %d", scene.killed_count);
         ImGui::Text("Time speed: %.2f", timeSpeed);
+        ImGui::Text("Draw calls: %d (%s), state changes: %d", graphics.draw_calls,
+                    graphics.instancingActive() ? "instanced" : "per entity", graphics.state_changes);
+        ImGui::Text("Entities drawn: %zu, culled: %zu", graphics.culler.visible().size(),
+                    graphics.culler.culledCount());
+        ImGui::Text("Triangles: %zu (%zu without LOD)", graphics.triangles, graphics.triangles_without_lod);
+        ImGui::Text("Streamed: %zu bytes/frame (%s)", graphics.stream.bytesStreamed(),
+                    graphics.stream.persistent() ? "persistent" : "orphaning");
+        ImGui::Text("Stream fence waits: %llu", (unsigned long long)graphics.stream.fenceWaits());
+        drawProfiler(graphics);
       }
       ImGui::End();
     }
@@ -54,6 +71,27 @@ struct UI {
     ImGui::EndFrame();
     ImGui::Render();
 
+    auto pass = graphics.gpu_timers.scope("imgui");
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
   }
+
+ private:
+  /**
+   * Rolling per-frame times of every profiler scope, with their p50/p99.
+   */
+  static void drawProfiler(const Graphics &graphics) {
+    ImGui::Separator();
+    if (!graphics.gpu_timers.enabled())
+      ImGui::Text("GPU timers unavailable");
+    for (const Profiler::Scope &scope : graphics.profiler.scopes()) {
+      std::vector<float> history = scope.chronological();
+      float p99 = scope.percentile(0.99f);
+      ImGui::Text("%s %-16s p50 %6.3f p99 %6.3f ms", scope.track == Profiler::Track::gpu ? "GPU" : "CPU",
+                  scope.name, scope.percentile(0.5f), p99);
+      ImGui::SameLine();
+      ImGui::PushID(&scope);
+      ImGui::PlotHistogram("", history.data(), (int)history.size(), 0, nullptr, 0.0f, std::max(p99, 0.01f), ImVec2(120, 16));
+      ImGui::PopID();
+    }
+  }
 };
\ No newline at end of file
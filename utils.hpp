@@ -1,54 +1,274 @@
 #pragma once
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstdint>
+#include <optional>
+#include <string>
 #include <vector>
 #include <GL/glew.h>
 
-uint loadTexture(const std::string& path) {
-  stbi_set_flip_vertically_on_load(true);
-  int width, height, nrChannels;
-  unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0);
-  assert(data);
+#include "mapped_file.hpp"
+#include "blob.hpp"
+#include "texture_cache.hpp"
+#include "texture_data.hpp"
 
-  uint texI;
-  glGenTextures(1, &texI);
-  glBindTexture(GL_TEXTURE_2D, texI);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+/**
+ * Staging buffer for texture uploads (GL_PIXEL_UNPACK_BUFFER): glTexImage2D sources from it,
+ * so the transfer to the texture can proceed without the GL thread waiting on it.
+ * Orphaned per upload. Not available in WebGL 1, where uploads read client memory directly.
+ */
+class PixelUnpackBuffer {
+ public:
+  static bool supported() {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    return GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object;
+#endif
+  }
+
+  PixelUnpackBuffer() = default;
+  PixelUnpackBuffer(const PixelUnpackBuffer&) = delete;
+  PixelUnpackBuffer& operator=(const PixelUnpackBuffer&) = delete;
+
+  ~PixelUnpackBuffer() {
+    glDeleteBuffers(1, &buffer_);
+  }
+
+  /**
+   * Copies `data` into the buffer and leaves it bound; returns the pointer to pass to glTexImage2D.
+   */
+  const void *stage(const void *data, size_t size) {
+    if (!buffer_)
+      glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, data, GL_STREAM_DRAW);
+    staged_bytes_ += size;
+    return nullptr; // offset 0
+  }
+
+  void unbind() {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  [[nodiscard]] size_t stagedBytes() const {
+    return staged_bytes_;
+  }
+
+ private:
+  uint buffer_ = 0;
+  size_t staged_bytes_ = 0;
+};
+
+/**
+ * Specifies mip `level` of `target` (GL_TEXTURE_2D or a cube face) of the bound texture,
+ * through `staging` if given.
+ */
+inline void texLevel(GLenum target, GLint level, TextureFormat format, const TextureLevelView &data,
+                     PixelUnpackBuffer *staging = nullptr) {
+  const void *pixels = (staging ? staging->stage(data.data, data.size) : data.data);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (format == TextureFormat::rgb8) {
+    glTexImage2D(target, level, GL_RGB, data.width, data.height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+  } else {
+    GLenum internal_format = (format == TextureFormat::bc1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+    glCompressedTexImage2D(target, level, internal_format, data.width, data.height, 0, data.size, pixels);
+  }
+  if (staging)
+    staging->unbind();
+}
+
+inline void texImage(GLenum target, const Image& image, PixelUnpackBuffer *staging = nullptr) {
+  const void *pixels = (staging ? staging->stage(image.pixels.data(), image.pixels.size()) : image.pixels.data());
+  GLenum format = (image.channels == 4 ? GL_RGBA : GL_RGB);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(target, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+  if (staging)
+    staging->unbind();
+}
+
+/**
+ * A GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP showing one colour (0xRRGGBB) until real images replace it.
+ */
+inline uint createTexture(GLenum type, uint32_t placeholder_rgb = 0x808080) {
+  Image placeholder{1, 1, 3, {
+      (unsigned char)(placeholder_rgb >> 16), (unsigned char)(placeholder_rgb >> 8), (unsigned char)placeholder_rgb}};
+
+  uint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(type, texture);
+    if (type == GL_TEXTURE_CUBE_MAP) {
+      for (uint face = 0; face < 6; face++)
+        texImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, placeholder);
+      glTexParameteri(type, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    } else {
+      texImage(type, placeholder);
+    }
+    glTexParameteri(type, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(type, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(type, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(type, 0);
+  return texture;
+}
+
+/**
+ * Whether the GL can sample `format`; only S3TC needs an extension.
+ */
+inline bool textureFormatSupported(TextureFormat format) {
+  if (!isCompressed(format))
+    return true;
+#ifdef __EMSCRIPTEN__
+  return false;
+#else
+  return GLEW_EXT_texture_compression_s3tc;
+#endif
+}
+
+/**
+ * CPU half of loadTexture, safe to run off the GL thread: the baked container next to the
+ * image if it is up to date and the GL supports its format, otherwise the decoded image.
+ */
+struct TextureAsset {
+  std::string path;
+  bool flipped = false;
+  std::optional<texture_cache::CachedTexture> cached;
+  Image image;
+
+  /**
+   * The image, decoding the source now if only the container was read.
+   */
+  [[nodiscard]] Image decoded() const {
+    return cached ? decodeImage(path, flipped) : image;
+  }
+};
+
+inline TextureAsset readTexture(const std::string& path, bool flip_vertically) {
+  TextureAsset asset{path, flip_vertically, std::nullopt, {}};
+  {
+    MappedFile source(path);
+    assert(source.isOpen());
+    uint64_t source_hash = hashBytes(source.data(), source.size());
+    asset.cached = texture_cache::open(texture_cache::cachePath(path), source_hash, flip_vertically);
+  }
+  if (asset.cached && !textureFormatSupported(asset.cached->view().format))
+    asset.cached.reset();
+  if (!asset.cached)
+    asset.image = decodeImage(path, flip_vertically);
+  return asset;
+}
+
+/**
+ * GL half of loadTexture, for the bound GL_TEXTURE_2D: the baked mip chain, or the image
+ * with mipmaps generated.
+ */
+inline void uploadTexture(const TextureAsset& asset, PixelUnpackBuffer *staging = nullptr) {
+  if (asset.cached) {
+    TextureView view = asset.cached->view();
+    for (uint32_t level = 0; level < view.level_count; level++)
+      texLevel(GL_TEXTURE_2D, level, view.format, view.levels[level], staging);
+  } else {
+    texImage(GL_TEXTURE_2D, asset.image, staging);
     glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+}
+
+/**
+ * GL half of loadCubemap, for the bound GL_TEXTURE_CUBE_MAP. The baked mip chains are only
+ * used if all six faces have matching ones; a cube map whose faces differ is incomplete.
+ */
+inline void uploadCubemap(const std::array<TextureAsset, 6>& faces, PixelUnpackBuffer *staging = nullptr) {
+  auto matches = [&](const TextureAsset &face) {
+    if (!face.cached || !faces[0].cached)
+      return false;
+    TextureView a = face.cached->view(), b = faces[0].cached->view();
+    return a.format == b.format && a.level_count == b.level_count
+        && a.levels[0].width == b.levels[0].width && a.levels[0].height == b.levels[0].height;
+  };
+  bool baked = std::all_of(faces.begin(), faces.end(), matches);
+
+  for (uint face = 0; face < faces.size(); face++) {
+    GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+    if (baked) {
+      TextureView view = faces[face].cached->view();
+      for (uint32_t level = 0; level < view.level_count; level++)
+        texLevel(target, level, view.format, view.levels[level], staging);
+    } else if (faces[face].cached) {
+      texImage(target, faces[face].decoded(), staging);
+    } else {
+      texImage(target, faces[face].image, staging);
+    }
+  }
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, baked ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+}
+
+uint loadTexture(const std::string& path) {
+  uint texI = createTexture(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, texI);
+    uploadTexture(readTexture(path, true));
   glBindTexture(GL_TEXTURE_2D, 0);
   return texI;
 }
 
 uint loadCubemap(const std::vector<std::string>& faces) {
-  stbi_set_flip_vertically_on_load(false);
-  uint textureID;
-  glGenTextures(1, &textureID);
+  assert(faces.size() == 6);
+  std::array<TextureAsset, 6> assets;
+  for (uint i = 0; i < faces.size(); i++)
+    assets[i] = readTexture(faces[i], false);
+
+  uint textureID = createTexture(GL_TEXTURE_CUBE_MAP);
   glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    uploadCubemap(assets);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  return textureID;
+}
 
-  int width, height, nrChannels;
-  for (uint i = 0; i < faces.size(); i++) {
-    unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-    assert(data);
+#ifndef __EMSCRIPTEN__
+/**
+ * A buffer object read as a texture (GL_TEXTURE_BUFFER, texelFetch in shaders), re-specified on each upload.
+ * Not available in WebGL.
+ */
+struct BufferTexture {
+  uint buffer = 0;
+  uint texture = 0;
 
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-    );
+  explicit BufferTexture(GLenum format) {
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+      glBufferData(GL_TEXTURE_BUFFER, MIN_SIZE, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
-    stbi_image_free(data);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+      glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
   }
 
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  BufferTexture(const BufferTexture&) = delete;
+  BufferTexture& operator=(const BufferTexture&) = delete;
 
-  return textureID;
-}
+  ~BufferTexture() {
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &buffer);
+  }
+
+  void upload(const void *data, size_t size) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+      // Orphan, the previous frame may still be reading the old storage
+      glBufferData(GL_TEXTURE_BUFFER, std::max(size, MIN_SIZE), nullptr, GL_STREAM_DRAW);
+      glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+
+  void bind(int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+  }
 
+ private:
+  static constexpr size_t MIN_SIZE = 16;
+};
+#endif
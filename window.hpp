@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <GL/glew.h>
+
+#include <GLFW/glfw3.h>
+
+/**
+ * How initGlewGLFW creates the window and its context. The defaults are the game's.
+ */
+struct WindowOptions {
+  int width = 1024;
+  int height = 768;
+  int samples = 4; // multisampling of the default framebuffer
+  bool visible = true;
+  // Create the context through EGL instead of GLX/WGL, e.g. for Mesa without a display server
+  bool egl = false;
+  // Offscreen tools have nobody to press a key on failure
+  bool wait_on_error = true;
+  const char *title = "Sample window";
+};
+
+/**
+ * Creates a window with a current GL 3.3 core (or, on the web, GLES 2) context and loads the GL
+ * functions; exits on failure. Visible windows capture the cursor for the mouse look.
+ */
+inline GLFWwindow* initGlewGLFW(const WindowOptions &options = {}) {
+  auto fail = [&](const char *message) {
+    std::cerr << message << std::endl;
+    if (options.wait_on_error)
+      getchar();
+    glfwTerminate();
+    exit(1);
+  };
+
+  // Initialise GLFW
+  if( !glfwInit() )
+    fail("Failed to initialize GLFW");
+
+  glfwWindowHint(GLFW_SAMPLES, options.samples);
+  glfwWindowHint(GLFW_VISIBLE, options.visible ? GLFW_TRUE : GLFW_FALSE);
+
+#ifndef __EMSCRIPTEN__
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  #ifdef __APPLE__
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
+  #endif
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
+  if (options.egl)
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+#else
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
+  glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
+#endif
+
+  GLFWwindow *window = glfwCreateWindow(options.width, options.height, options.title, nullptr, nullptr);
+  if (window == nullptr) {
+    const char* description = nullptr;
+    #ifndef __EMSCRIPTEN__
+    glfwGetError(&description);
+    #endif
+    if (description == nullptr)
+      description = "(no description available)";
+    std::cerr << description << "\n";
+    fail("Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.");
+  }
+
+  glfwMakeContextCurrent(window);
+
+  if (options.visible)
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+  if (glewInit() != GLEW_OK)
+    fail("Failed to initialize GLEW");
+  return window;
+}
@@ -3,7 +3,6 @@
 
 #include <chrono>
 #include <cmath>
-#include <deque>
 #include <iostream>
 #include <thread>
 #include <functional>
@@ -14,8 +13,6 @@
 #include <cstdlib>
 #include <random>
 
-#include <GLFW/glfw3.h>
-
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp> // translate, rotate, scale, perspective
 #include <glm/gtc/type_ptr.hpp> // value_ptr
@@ -23,13 +20,19 @@
 #include <glm/gtx/transform.hpp>
 using namespace glm;
 
-#include "input.hpp"
+#include "controls.hpp"
+#include "collision.hpp"
+#include "entities.hpp"
+#include "kernels.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+#include "timer_wheel.hpp"
 
 struct QuatTransform {
   glm::vec3 pos;
   glm::quat dir;
 
-  glm::mat4 getMat() {
+  [[nodiscard]] glm::mat4 getMat() const {
     return glm::translate(pos) * glm::mat4(dir);
   }
 };
@@ -47,61 +50,397 @@ struct AngleTransform {
   [[nodiscard]] glm::quat getForwardDir() const {
     return glm::angleAxis(-horizontal_angle, glm::vec3{0, 1, 0});
   }
+
+  static AngleTransform mix(const AngleTransform& a, const AngleTransform& b, float t) {
+    return {
+        glm::mix(a.pos, b.pos, t),
+        glm::mix(a.horizontal_angle, b.horizontal_angle, t),
+        glm::mix(a.vertical_angle, b.vertical_angle, t)
+    };
+  }
 };
 
-struct DyingObject {
+/**
+ * Transform columns shared by stores of moving things.
+ */
+template <typename Derived>
+struct TransformColumns : EntityStore<Derived> {
+  std::vector<glm::vec3> pos;
+  std::vector<glm::quat> dir;
+  // State at the start of the last tick, for render interpolation
+  std::vector<glm::vec3> prev_pos;
+  std::vector<glm::quat> prev_dir;
+
+  [[nodiscard]] QuatTransform transform(size_t i) const {
+    return {pos[i], dir[i]};
+  }
+
+  [[nodiscard]] QuatTransform interpolated(size_t i, float alpha) const {
+    return {glm::mix(prev_pos[i], pos[i], alpha), glm::slerp(prev_dir[i], dir[i], alpha)};
+  }
+
+  void storePrevious() {
+    std::copy(pos.begin(), pos.end(), prev_pos.begin());
+    std::copy(dir.begin(), dir.end(), prev_dir.begin());
+  }
+
+ protected:
+  void pushTransform(const QuatTransform& transform) {
+    pos.push_back(transform.pos);
+    dir.push_back(transform.dir);
+    prev_pos.push_back(transform.pos);
+    prev_dir.push_back(transform.dir);
+  }
+
+  template <typename TFunc>
+  void forEachTransformColumn(TFunc&& f) {
+    f(pos);
+    f(dir);
+    f(prev_pos);
+    f(prev_dir);
+  }
+};
+
+struct TransformStore : TransformColumns<TransformStore> {
+  EntityHandle add(const QuatTransform& transform) {
+    pushTransform(transform);
+    return allocate();
+  }
+
+  template <typename TFunc>
+  void forEachColumn(TFunc&& f) {
+    forEachTransformColumn(f);
+  }
+};
+
+struct ProjectileStore : TransformColumns<ProjectileStore> {
+  // Projectiles fly straight, so the velocity is computed once at spawn
+  std::vector<glm::vec3> velocity;
+
+  EntityHandle add(const QuatTransform& transform, const glm::vec3& vel) {
+    pushTransform(transform);
+    velocity.push_back(vel);
+    return allocate();
+  }
+
+  template <typename TFunc>
+  void forEachColumn(TFunc&& f) {
+    forEachTransformColumn(f);
+    f(velocity);
+  }
+};
+
+struct DyingObjects : EntityStore<DyingObjects> {
   enum class Kind { enemy, projectile };
-  QuatTransform transform;
-  glm::vec3 explosion_pos;
-  glm::vec3 explosion_dir;
-  Kind kind;
-  double death_start;
+
+  std::vector<glm::vec3> pos;
+  std::vector<glm::quat> dir;
+  std::vector<glm::vec3> explosion_pos;
+  std::vector<glm::vec3> explosion_dir;
+  std::vector<Kind> kind;
+  std::vector<double> death_start;
   constexpr static double death_duration = 1;
+
+  EntityHandle add(const QuatTransform& transform, glm::vec3 expl_pos, glm::vec3 expl_dir, Kind k, double start) {
+    pos.push_back(transform.pos);
+    dir.push_back(transform.dir);
+    explosion_pos.push_back(expl_pos);
+    explosion_dir.push_back(expl_dir);
+    kind.push_back(k);
+    death_start.push_back(start);
+    return allocate();
+  }
+
+  [[nodiscard]] QuatTransform transform(size_t i) const {
+    return {pos[i], dir[i]};
+  }
+
+  template <typename TFunc>
+  void forEachColumn(TFunc&& f) {
+    f(pos);
+    f(dir);
+    f(explosion_pos);
+    f(explosion_dir);
+    f(kind);
+    f(death_start);
+  }
+};
+
+/**
+ * The defaults are the game as designed: a few enemies at a time. Large scenes are for the
+ * stress tools, headless and the game's --max-enemies/--spawn-delay options.
+ */
+struct SceneConfig {
+  double spawn_delay = 1.0;
+  size_t max_enemies = 10;
 };
 
 class Scene {
  public:
-  Scene(InputContext *input_ctx, int64_t random_seed)
-        : input_(input_ctx)
+  Scene(InputSource *input, int64_t random_seed, SceneConfig config = {})
+        : config_(config)
+        , input_(input)
         , random_engine_(random_seed)
-        , cursor_(input_ctx->mouse_input.getPos()) {
+        , cursor_(input->poll().cursor) {
   }
 
  public:
   AngleTransform player{
       {0, 0, 0}, 0.0f, 0.0f
   };
-  std::vector<QuatTransform> enemies;
-  std::vector<QuatTransform> projectiles;
-  std::deque<DyingObject> dying_objects;
+  AngleTransform prev_player = player;
+  TransformStore enemies;
+  ProjectileStore projectiles;
+  DyingObjects dying_objects;
   int killed_count = 0;
 
   static constexpr glm::vec3 PERSON_HEAD{0, 1.35, 0};
 
-  void update(double elapsed_time, double game_time) {
+  enum class Phase { move_player, spawn_enemies, move_projectiles, check_collisions, clear_memory, count };
+  static constexpr const char *PHASE_NAMES[(size_t)Phase::count] = {
+      "movePlayer", "spawnEnemies", "moveProjectiles", "checkCollisions", "clearMemory"
+  };
+
+  // Wall-clock seconds spent in each phase, accumulated while measure_phases is set
+  bool measure_phases = false;
+  double phase_seconds[(size_t)Phase::count] = {};
+  // If set, every phase is also recorded as a CPU scope
+  Profiler *profiler = nullptr;
+  // If set, projectile movement and the collision queries are split over it in batches of PARALLEL_BATCH;
+  // the outcome is the same as without it
+  ThreadPool *pool = nullptr;
+
+  static constexpr size_t PARALLEL_BATCH = 1024; // projectiles per task
+
+  void update(double elapsed_time) {
     time_ += elapsed_time;
-    movePlayer(elapsed_time);
-    spawnEnemies(elapsed_time);
-    moveProjectiles(elapsed_time);
-    checkCollisions();
-    clearMemory(game_time);
+    // Enemies never move, so their previous state stays the spawn state
+    prev_player = player;
+    projectiles.storePrevious();
+
+    timePhase(Phase::move_player, [&] { movePlayer(elapsed_time); });
+    timePhase(Phase::spawn_enemies, [&] { spawnEnemies(); });
+    timePhase(Phase::move_projectiles, [&] { moveProjectiles(elapsed_time); });
+    timePhase(Phase::check_collisions, [&] { checkCollisions(); });
+    timePhase(Phase::clear_memory, [&] { clearMemory(); });
+  }
+
+  [[nodiscard]] AngleTransform interpolatedPlayer(float alpha) const {
+    return AngleTransform::mix(prev_player, player, alpha);
+  }
+
+  EntityHandle spawnProjectile() {
+    return spawnProjectile(
+        QuatTransform{
+            player.pos + PERSON_HEAD + player.getDir() * FORWARD * 0.2f,
+            player.getDir()
+        },
+        player.getDir() * FORWARD * PROJECTILE_MOVE_SPEED
+    );
+  }
+
+  /**
+   * Adds a projectile that expires PROJECTILE_LIFETIME seconds from now.
+   */
+  EntityHandle spawnProjectile(const QuatTransform& transform, const glm::vec3& velocity) {
+    EntityHandle handle = projectiles.add(transform, velocity);
+    timers_.schedule(time_ + PROJECTILE_LIFETIME, {TimerEvent::Kind::projectile_expired, handle});
+    return handle;
   }
 
-  void spawnProjectile() {
-    projectiles.push_back(QuatTransform{
-        player.pos + PERSON_HEAD + player.getDir() * FORWARD * 0.2f,
-        player.getDir()
+  /**
+   * Hash of the simulation state (player, entity positions, kills); equal only if two runs
+   * made the same decisions, to check replays and thread counts against each other.
+   */
+  [[nodiscard]] uint64_t stateHash() const {
+    uint64_t hash = 14695981039346656037ull; // FNV-1a
+    auto mix = [&](const void *data, size_t size) {
+      for (size_t i = 0; i < size; i++)
+        hash = (hash ^ static_cast<const uint8_t*>(data)[i]) * 1099511628211ull;
+    };
+    mix(&player.pos, sizeof(player.pos));
+    mix(&player.horizontal_angle, sizeof(player.horizontal_angle));
+    mix(&player.vertical_angle, sizeof(player.vertical_angle));
+    mix(&killed_count, sizeof(killed_count));
+    mix(enemies.pos.data(), enemies.size() * sizeof(glm::vec3));
+    mix(projectiles.pos.data(), projectiles.size() * sizeof(glm::vec3));
+    mix(dying_objects.pos.data(), dying_objects.size() * sizeof(glm::vec3));
+    mix(dying_objects.kind.data(), dying_objects.size() * sizeof(DyingObjects::Kind));
+    return hash;
+  }
+
+  /**
+   * Timers pending for expiries and spawns, including those of projectiles already destroyed.
+   */
+  [[nodiscard]] size_t pendingTimers() const {
+    return timers_.size();
+  }
+
+  /**
+   * Enemies are put into a uniform grid by their feet position, then the path each projectile
+   * took during the tick is swept against the enemy volumes near it, so fast projectiles and
+   * long ticks do not tunnel through enemies.
+   *
+   * The queries only collect every (projectile, enemy, time of entry) contact, in parallel per
+   * batch of projectiles. Kills are then resolved on this thread in order of entry time (then
+   * projectile, then enemy index), as if the tick had been simulated in infinitely small steps:
+   * a projectile kills the first live enemy it enters. With every projectile at rest that is
+   * the lowest-index enemy it touches, same as the old all-pairs loop. The order does not
+   * depend on the thread count.
+   */
+  void checkCollisions() {
+    enemy_grid_.build(enemies.pos.data(), enemies.size());
+
+    enemy_dead_.assign(enemies.size(), false);
+    projectile_dead_.assign(projectiles.size(), false);
+    killed_enemies_.clear();
+    killed_projectiles_.clear();
+
+    size_t batches = (projectiles.size() + PARALLEL_BATCH - 1) / PARALLEL_BATCH;
+    if (contact_batches_.size() < batches)
+      contact_batches_.resize(batches);
+    forEachBatch(projectiles.size(), [&](size_t batch, size_t begin, size_t end) {
+      findContacts(contact_batches_[batch], begin, end);
     });
+
+    contacts_.clear();
+    for (size_t batch = 0; batch < batches; batch++)
+      contacts_.insert(contacts_.end(), contact_batches_[batch].contacts.begin(), contact_batches_[batch].contacts.end());
+    std::sort(contacts_.begin(), contacts_.end());
+    for (const Contact &contact : contacts_) {
+      if (!enemy_dead_[contact.enemy] && !projectile_dead_[contact.projectile])
+        kill(contact.projectile, contact.enemy, contact.entry);
+    }
+
+    // Swap-and-pop from the highest index down, so no pending index gets moved
+    std::sort(killed_enemies_.begin(), killed_enemies_.end(), std::greater<>());
+    for (size_t ie : killed_enemies_)
+      enemies.remove(ie);
+    std::sort(killed_projectiles_.begin(), killed_projectiles_.end(), std::greater<>());
+    for (size_t ip : killed_projectiles_)
+      projectiles.remove(ip);
   }
 
  private:
-  void spawnEnemies(double elapsed_time) {
-    elapsed_since_last_enemy_spawn_ += elapsed_time;
-    if (elapsed_since_last_enemy_spawn_ < SPAWN_DELAY || enemies.size() >= MAX_ENEMIES) {
+  struct Contact {
+    float entry; // in [0, 1] along the projectile's path during the tick
+    uint32_t projectile;
+    uint32_t enemy;
+
+    bool operator<(const Contact &other) const {
+      if (entry != other.entry)
+        return entry < other.entry;
+      return projectile != other.projectile ? projectile < other.projectile : enemy < other.enemy;
+    }
+  };
+
+  struct ContactBatch {
+    std::vector<Contact> contacts;
+    std::vector<float> entries;
+  };
+
+  /**
+   * Calls f(batch, begin, end) for the batches of PARALLEL_BATCH out of `count`, on the pool if any.
+   */
+  template <typename TFunc>
+  void forEachBatch(size_t count, TFunc f) {
+    size_t batches = (count + PARALLEL_BATCH - 1) / PARALLEL_BATCH;
+    auto run = [&](size_t batch) {
+      f(batch, batch * PARALLEL_BATCH, std::min(count, (batch + 1) * PARALLEL_BATCH));
+    };
+    if (pool) {
+      pool->parallelFor(batches, run);
+    } else {
+      for (size_t batch = 0; batch < batches; batch++)
+        run(batch);
+    }
+  }
+
+  /**
+   * The grid holds points and its queries reach at most one cell around the center, so a long
+   * path is covered by several queries along it, each a cube around one piece of the path
+   * grown by the enemy bounding radius. An enemy found by more than one is tested once.
+   */
+  void findContacts(ContactBatch &batch, size_t begin, size_t end) const {
+    const SimdKernels& kernels = simdKernels();
+    const float max_piece = 2 * (enemy_grid_.cellSize() - ENEMY_BOUNDING_RADIUS);
+    batch.contacts.clear();
+    for (size_t ip = begin; ip < end; ip++) {
+      const glm::vec3& from = projectiles.prev_pos[ip];
+      glm::vec3 delta = projectiles.pos[ip] - from;
+      // The grid has the enemies' feet, the volume is centered between the feet and the head
+      glm::vec3 query_from = from - PERSON_HEAD * 0.5f;
+      float length = glm::length(delta);
+      size_t pieces = std::max<size_t>(1, (size_t)std::ceil(length / max_piece));
+      size_t first = batch.contacts.size();
+      for (size_t piece = 0; piece < pieces; piece++) {
+        glm::vec3 center = query_from + delta * (((float)piece + 0.5f) / (float)pieces);
+        enemy_grid_.queryBlocks(
+            center, ENEMY_BOUNDING_RADIUS + length / (float)pieces * 0.5f,
+            [&](const uint32_t *indices, const float *xs, const float *ys, const float *zs, size_t count) {
+              batch.entries.resize(std::max(batch.entries.size(), count));
+              kernels.sweptEllipsoidHits(from, delta, xs, ys, zs, count, PERSON_HEAD.y, COLLISION_DISTANCE_SUM, batch.entries.data());
+              for (size_t k = 0; k < count; k++) {
+                if (batch.entries[k] <= 1)
+                  batch.contacts.push_back({batch.entries[k], (uint32_t)ip, indices[k]});
+              }
+            });
+      }
+      if (pieces > 1) {
+        std::sort(batch.contacts.begin() + first, batch.contacts.end());
+        batch.contacts.erase(std::unique(batch.contacts.begin() + first, batch.contacts.end(),
+                                         [](const Contact &a, const Contact &b) { return a.enemy == b.enemy; }),
+                             batch.contacts.end());
+      }
+    }
+  }
+
+  /**
+   * The projectile dies where it entered the enemy.
+   */
+  void kill(size_t ip, size_t hit, float entry) {
+    glm::vec3 expl = glm::mix(projectiles.prev_pos[ip], projectiles.pos[ip], entry);
+    glm::vec3 expl_dir = projectiles.velocity[ip];
+    addDying(enemies.transform(hit), expl, expl_dir, DyingObjects::Kind::enemy);
+    addDying(QuatTransform{expl, projectiles.dir[ip]}, expl, expl_dir, DyingObjects::Kind::projectile);
+
+    enemy_dead_[hit] = true;
+    projectile_dead_[ip] = true;
+    killed_enemies_.push_back(hit);
+    killed_projectiles_.push_back(ip);
+    killed_count++;
+  }
+
+  template <typename TFunc>
+  void timePhase(Phase phase, TFunc f) {
+    if (!measure_phases && !profiler) {
+      f();
       return;
     }
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    if (measure_phases)
+      phase_seconds[(size_t)phase] += std::chrono::duration<double>(end - start).count();
+    if (profiler)
+      profiler->record(PHASE_NAMES[(size_t)phase], Profiler::Track::cpu, profiler->toNs(start), profiler->toNs(end));
+  }
+
+  /**
+   * Spawns in the tick whose time has passed the deadline, several if the delay is shorter than
+   * a tick. The spawn is a single deadline, not a per-entity expiry, so it stays out of the timer
+   * wheel, which only fires at the end of the tick.
+   */
+  void spawnEnemies() {
+    while (next_spawn_time_ <= time_ && enemies.size() < config_.max_enemies) {
+      spawnEnemy();
+      next_spawn_time_ += config_.spawn_delay;
+    }
+    // Don't let a full scene bank up a burst of spawns: when room appears, spawn once, then on schedule
+    next_spawn_time_ = std::max(next_spawn_time_, time_);
+  }
 
-    elapsed_since_last_enemy_spawn_ = 0;
+  void spawnEnemy() {
     float dist = std::uniform_real_distribution(2.0f, 5.0f)(random_engine_);
     float wing = glm::pi<float>() * 2 * 0.2;
     float ang = std::uniform_real_distribution(-wing, +wing)(random_engine_);
@@ -114,26 +453,28 @@ class Scene {
     float enemy_rot = std::uniform_real_distribution(0.0f, glm::pi<float>() * 2)(random_engine_) - glm::pi<float>();
     glm::quat enemy_dir = glm::angleAxis(enemy_rot, glm::vec3{0, 1, 0});
 
-    enemies.push_back(QuatTransform{enemy_pos, enemy_dir});
+    enemies.add(QuatTransform{enemy_pos, enemy_dir});
   }
 
   void movePlayer(double elapsed_time) {
-    glm::vec3 delta;
-    if (glfwGetKey(input_->window, GLFW_KEY_D) == GLFW_PRESS)
+    PlayerControls controls = input_->poll();
+
+    glm::vec3 delta{0, 0, 0};
+    if (controls.right)
       delta += RIGHT;
-    if (glfwGetKey(input_->window, GLFW_KEY_A) == GLFW_PRESS)
+    if (controls.left)
       delta += -RIGHT;
 
-    if (glfwGetKey(input_->window, GLFW_KEY_W) == GLFW_PRESS)
+    if (controls.forward)
       delta += FORWARD;
-    if (glfwGetKey(input_->window, GLFW_KEY_S) == GLFW_PRESS)
+    if (controls.backward)
       delta += -FORWARD;
 
-    if (glfwGetKey(input_->window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
+    if (controls.slow)
       delta *= 0.1;
 
-    glm::vec2 cursor_delta = input_->mouse_input.getPos() - cursor_;
-    cursor_ = input_->mouse_input.getPos();
+    glm::vec2 cursor_delta = controls.cursor - cursor_;
+    cursor_ = controls.cursor;
     double horizontal_angle_shift = glm::pi<double>() * 2 * cursor_delta.x / X_FULL_CURSOR_ROTATION;
     double vertical_angle_shift = -glm::pi<double>() * 2 * cursor_delta.y / Y_FULL_CURSOR_ROTATION;
 
@@ -144,57 +485,45 @@ class Scene {
   }
 
   void moveProjectiles(double elapsed_time) {
-    for (auto& projectile : projectiles) {
-      projectile.pos += projectile.dir * FORWARD * (float)elapsed_time * PROJECTILE_MOVE_SPEED;
-    }
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
+    forEachBatch(projectiles.size(), [&](size_t, size_t begin, size_t end) {
+      simdKernels().integrate(
+          reinterpret_cast<float *>(projectiles.pos.data() + begin),
+          reinterpret_cast<const float *>(projectiles.velocity.data() + begin),
+          (end - begin) * 3,
+          (float)elapsed_time
+      );
+    });
   }
 
-  void checkCollisions() {
-    for (size_t ip = 0; ip < projectiles.size(); ip++) {
-      for (size_t ie = 0; ie < enemies.size(); ie++) {
-        if (checkCollision(projectiles[ip].pos, enemies[ie].pos)) {
-          glm::vec3 expl = projectiles[ip].pos;
-          glm::vec3 expl_dir = (projectiles[ip].dir * FORWARD) * PROJECTILE_MOVE_SPEED;
-          dying_objects.push_back(DyingObject{enemies[ie], expl, expl_dir, DyingObject::Kind::enemy, time_});
-          dying_objects.push_back(DyingObject{projectiles[ip], expl, expl_dir, DyingObject::Kind::projectile, time_});
-
-          enemies.erase(enemies.begin() + ie);
-          projectiles.erase(projectiles.begin() + ip);
-
-          killed_count++;
-          ip--;
-          break;
-        }
-      }
-    }
+  void addDying(const QuatTransform& transform, glm::vec3 expl_pos, glm::vec3 expl_dir, DyingObjects::Kind kind) {
+    EntityHandle handle = dying_objects.add(transform, expl_pos, expl_dir, kind, time_);
+    timers_.schedule(time_ + DyingObjects::death_duration, {TimerEvent::Kind::death_ended, handle});
   }
 
-  void clearMemory(double game_time) {
-    for (size_t ip = 0; ip < projectiles.size(); ip++) {
-      if (glm::length(projectiles[ip].pos - player.pos) > 100) {
-        projectiles.erase(projectiles.begin() + ip);
-        ip--;
+  /**
+   * Fires the timers due by now, on the same clock they were scheduled with; a tick without
+   * expiries touches no entity. Handles of projectiles destroyed early are stale by now and
+   * removing them does nothing.
+   */
+  void clearMemory() {
+    timers_.advance(time_, [&](const TimerEvent& event) {
+      switch (event.kind) {
+        case TimerEvent::Kind::projectile_expired: projectiles.remove(event.handle); break;
+        case TimerEvent::Kind::death_ended: dying_objects.remove(event.handle); break;
       }
-    }
-
-    for (size_t id = 0; id < dying_objects.size(); id++) {
-      if (game_time - dying_objects[id].death_start > dying_objects[id].death_duration) {
-        dying_objects.erase(dying_objects.begin() + id);
-        id--;
-      }
-    }
+    });
   }
 
+ public:
+  // Reference narrow phase test, the batch kernels must agree with it
   static bool checkCollision(const glm::vec3& proj_pos, const glm::vec3& enemy_pos) {
     float top_dist = glm::distance(proj_pos, enemy_pos + PERSON_HEAD);
     float bot_dist = glm::distance(proj_pos, enemy_pos);
-    return top_dist + bot_dist < 2;
+    return top_dist + bot_dist < COLLISION_DISTANCE_SUM;
   }
 
  private:
-  static constexpr double SPAWN_DELAY = 1.0;
-  static constexpr int MAX_ENEMIES = 10;
-
   static constexpr glm::vec3
       UP{0, 1, 0},
       RIGHT{1, 0, 0},
@@ -207,10 +536,36 @@ class Scene {
   static constexpr double MAX_PLAYER_VERTICAL_ANGLE = glm::pi<double>() / 2;
 
   static constexpr float PROJECTILE_MOVE_SPEED = 5;
+  // Time to fly 100 units, the distance at which projectiles used to be dropped
+  static constexpr double PROJECTILE_LIFETIME = 100 / PROJECTILE_MOVE_SPEED;
+  // Finer than any tick rate, so expiries are not noticeably late
+  static constexpr double TIMER_RESOLUTION = 1.0 / 1024;
+
+  // Enemy volume is an ellipsoid with foci at the feet and the head
+  static constexpr float COLLISION_DISTANCE_SUM = 2;
+  static constexpr float ENEMY_BOUNDING_RADIUS = COLLISION_DISTANCE_SUM / 2;
 
-  InputContext *input_;
+  SceneConfig config_;
+  InputSource *input_;
   std::default_random_engine random_engine_;
   glm::vec2 cursor_;
-  double elapsed_since_last_enemy_spawn_{SPAWN_DELAY};
   double time_ = 0;
+
+  struct TimerEvent {
+    enum class Kind : uint8_t { projectile_expired, death_ended };
+    Kind kind;
+    EntityHandle handle; // of the projectile or dying object
+  };
+
+  TimerWheel<TimerEvent> timers_{TIMER_RESOLUTION};
+  // The first spawn happens on the first tick
+  double next_spawn_time_ = 0;
+
+  SpatialHash enemy_grid_{ENEMY_BOUNDING_RADIUS * 2};
+  std::vector<ContactBatch> contact_batches_;
+  std::vector<Contact> contacts_;
+  std::vector<char> enemy_dead_;
+  std::vector<char> projectile_dead_;
+  std::vector<size_t> killed_enemies_;
+  std::vector<size_t> killed_projectiles_;
 };